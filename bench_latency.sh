@@ -0,0 +1,32 @@
+#!/bin/bash
+# Run ta_partB at several TA counts and tabulate per-exam latency percentiles.
+# Usage: ./bench_latency.sh [ta_counts...] (default: 2 4 8 16), extra ta_partB options via TA_OPTS
+counts=${*:-2 4 8 16}
+report=$(mktemp)
+run_report=$(mktemp)
+source "$(dirname "$0")/rubric_guard.sh"
+cleanup_files+=("$report" "$run_report")
+
+for n in $counts; do
+    echo "Running with $n TA(s)..."
+    restore_rubric
+    : > "$run_report"
+    ./ta_partB "$n" $TA_OPTS --report-json="$run_report" > /dev/null
+    status=$?
+    if [ $status -ne 0 ]; then
+        echo "  ta_partB $n $TA_OPTS failed (exit $status), skipped"
+        continue
+    fi
+    cat "$run_report" >> "$report"
+done
+
+printf "\n%-5s %-9s %9s %12s %12s %12s %12s\n" "TAs" "mode" "elapsed" "turn p50" "turn p99" "queue p99" "mark p99"
+while read -r line; do
+    field() { echo "$line" | grep -o "\"$1\": {[^}]*}" | grep -o "\"$2\": [0-9]*" | grep -o "[0-9]*$"; }
+    num_tas=$(echo "$line" | grep -o '"num_tas": [0-9]*' | grep -o '[0-9]*$')
+    mode=$(echo "$line" | grep -o '"mode": "[a-z]*"' | head -1 | cut -d'"' -f4)
+    elapsed=$(echo "$line" | grep -o '"elapsed_ms": [0-9]*' | grep -o '[0-9]*$')
+    printf "%-5s %-9s %8sms %10sms %10sms %10sms %10sms\n" "$num_tas" "$mode" "$elapsed" \
+        "$(field turnaround_ms p50)" "$(field turnaround_ms p99)" \
+        "$(field queueing_ms p99)" "$(field marking_ms p99)"
+done < "$report"
@@ -0,0 +1,30 @@
+#!/bin/bash
+# Compare classic and team coordination as the TA count grows.
+# Usage: ./bench_teams.sh [ta_counts...] (default: 16 64 128 256)
+# TEAM_SIZE (default 8) and TIME_SCALE (default 0.1) tune the runs
+counts=${*:-16 64 128 256}
+team_size=${TEAM_SIZE:-8}
+time_scale=${TIME_SCALE:-0.1}
+report=$(mktemp)
+source "$(dirname "$0")/rubric_guard.sh"
+cleanup_files+=("$report")
+
+for n in $counts; do
+    for mode in classic teams; do
+        echo "Running $mode with $n TAs..."
+        extra=""
+        [ "$mode" = teams ] && extra="--teams=$team_size"
+        restore_rubric
+        ./ta_partB "$n" $extra --time-scale="$time_scale" $TA_OPTS --report-json="$report" > /dev/null
+    done
+done
+
+value() { echo "$1" | grep -o "\"$2\": [0-9.]*" | head -1 | grep -o "[0-9.]*$"; }
+printf "\n%-5s %-8s %6s %9s %13s %13s %14s %13s\n" "TAs" "mode" "teams" "elapsed" "global locks" "team locks" "global wait" "turn p99"
+while read -r line; do
+    mode=$(echo "$line" | grep -o '"mode": "[a-z]*"' | head -1 | cut -d'"' -f4)
+    turn_p99=$(echo "$line" | grep -o '"turnaround_ms": {[^}]*}' | grep -o '"p99": [0-9]*' | grep -o '[0-9]*$')
+    printf "%-5s %-8s %6s %7sms %13s %13s %12sms %11sms\n" "$(value "$line" num_tas)" "$mode" \
+        "$(value "$line" teams)" "$(value "$line" elapsed_ms)" "$(value "$line" acquisitions)" \
+        "$(value "$line" team_acquisitions)" "$(value "$line" mean_wait_ms)" "$turn_p99"
+done < "$report"
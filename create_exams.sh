@@ -1,10 +1,19 @@
 #!/bin/bash
+# Each exam: a header line with the student number, then one "Q<n>:" answer section per question
 for i in {0001..0020}; do
     if [ $i -eq 0020 ]; then
         echo "9999" > "exam_$i.txt"
     else
         student_num=$((10#$i))  # Force base-10 interpretation
-        echo "$student_num" > "exam_$i.txt"
+        {
+            echo "$student_num"
+            for q in 1 2 3 4 5; do
+                echo "Q$q:"
+                for line in $(seq 1 $((q + student_num % 3))); do
+                    echo "Student $student_num answer to question $q, paragraph $line."
+                done
+            done
+        } > "exam_$i.txt"
     fi
 done
-echo "Exam files created successfully!"
\ No newline at end of file
+echo "Exam files created successfully!"
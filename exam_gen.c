@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// exam_gen: parallel generator of exam corpora for load testing. Writes exams in the
+// exam_NNNN.txt layout Part B reads, or all of them into one packed file, plus an optional
+// rubric.txt of any length. Every exam is generated from (seed, exam number) alone, so the
+// output is byte-identical whatever the thread count.
+
+#define TERMINATOR_ID 9999
+#define PACK_MAGIC "TAPACK"
+#define PACK_VERSION 1
+#define PACK_CHUNK 4096         // Packed mode: exams per unit of work
+#define PARAGRAPH_BYTES 80      // Target length of one answer line
+#define MAX_ANSWER_BYTES (1 << 20)
+
+typedef enum {
+    IDS_SEQUENTIAL = 0,     // 1, 2, 3, ... (skipping the terminator id)
+    IDS_UNIFORM,            // Random 9-digit student numbers
+    IDS_ZIPF                // A few student numbers submit many exams (resubmissions)
+} id_mode_t;
+
+typedef struct {
+    long long count;        // Student exams, not counting the terminator
+    int questions;
+    int answer_bytes;       // Mean bytes per answer section
+    id_mode_t ids;
+    unsigned long long seed;
+    int threads;
+    int terminator;         // Append a 9999 exam after the last one
+    const char *dir;
+    const char *packed;     // Packed output file (NULL: one file per exam)
+    int rubric_lines;       // Write rubric.txt with this many lines (0: leave it alone)
+} gen_options_t;
+
+typedef struct {
+    const gen_options_t *opts;
+    long long first, last;          // Exams [first, last) for per-file mode
+    int fd;                         // Packed mode: output file
+    long long *chunk_bytes;         // Packed mode: size of every chunk (pass 1) ...
+    long long *chunk_offset;        // ... and where it goes in the file (pass 2)
+    long long num_chunks;
+    long long *next_chunk;          // Packed mode: shared chunk cursor (atomic)
+    long long bytes;                // Written by this thread
+    int failed;
+} gen_worker_t;
+
+static const char *filler[] = {
+    "the", "process", "holds", "a", "semaphore", "while", "it", "marks", "each", "question",
+    "so", "no", "other", "TA", "can", "enter", "critical", "section", "shared", "memory",
+    "segment", "rubric", "is", "updated", "under", "mutual", "exclusion", "and", "deadlock",
+    "cannot", "occur", "because", "locks", "are", "always", "taken", "in", "order"
+};
+#define NUM_FILLER (int)(sizeof(filler) / sizeof(filler[0]))
+
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// splitmix64: one independent, reproducible stream per exam
+static unsigned long long next_random(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double next_unit(unsigned long long *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int student_id(const gen_options_t *opts, long long exam_number, unsigned long long *rng) {
+    long long id;
+    switch (opts->ids) {
+        case IDS_UNIFORM:
+            id = 100000000 + (long long)(next_random(rng) % 100000000ULL);
+            break;
+        case IDS_ZIPF:
+            // Log-uniform rank: P(rank) ~ 1/rank, so low ranks repeat often
+            id = 100000000 + (long long)exp(next_unit(rng) * log((double)opts->count + 1));
+            break;
+        default:
+            id = exam_number >= TERMINATOR_ID ? exam_number + 1 : exam_number;
+            break;
+    }
+    return (int)id;
+}
+
+static size_t append(char *buffer, size_t used, size_t size, const char *text) {
+    size_t length = strlen(text);
+    if (used + length < size) {
+        memcpy(buffer + used, text, length);
+        used += length;
+    }
+    return used;
+}
+
+// Render exam number n (1-based) into buffer, returns its length
+static size_t render_exam(const gen_options_t *opts, long long n, char *buffer, size_t size) {
+    if (opts->terminator && n == opts->count + 1) {
+        return (size_t)snprintf(buffer, size, "%d\n", TERMINATOR_ID);
+    }
+
+    unsigned long long rng = opts->seed ^ ((unsigned long long)n * 0xd1b54a32d192ed03ULL);
+    int id = student_id(opts, n, &rng);
+    size_t used = (size_t)snprintf(buffer, size, "%d\n", id);
+
+    char line[PARAGRAPH_BYTES * 2];
+    for (int q = 1; q <= opts->questions; q++) {
+        snprintf(line, sizeof(line), "Q%d:\n", q);
+        used = append(buffer, used, size, line);
+
+        // Each section's length varies +/-50% around the mean
+        long long target = opts->answer_bytes / 2 + (long long)(next_unit(&rng) * opts->answer_bytes);
+        long long written = 0;
+        for (int paragraph = 1; written < target; paragraph++) {
+            int length = snprintf(line, sizeof(line), "Student %d answer to question %d, paragraph %d:",
+                                  id, q, paragraph);
+            while (length < PARAGRAPH_BYTES - 12) {
+                length += snprintf(line + length, sizeof(line) - length, " %s",
+                                   filler[next_random(&rng) % NUM_FILLER]);
+            }
+            line[length++] = '.';
+            line[length++] = '\n';
+            line[length] = '\0';
+            used = append(buffer, used, size, line);
+            written += length;
+        }
+    }
+    return used;
+}
+
+static int write_all(int fd, const char *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = offset >= 0 ? pwrite(fd, data, length, offset) : write(fd, data, length);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+        if (offset >= 0) {
+            offset += n;
+        }
+    }
+    return 0;
+}
+
+static size_t exam_buffer_size(const gen_options_t *opts) {
+    // Sections run up to 1.5x the mean, plus the last paragraph's overshoot and the markers
+    return (size_t)opts->questions * ((size_t)opts->answer_bytes * 3 / 2 + PARAGRAPH_BYTES * 2 + 16) + 64;
+}
+
+static void *per_file_worker(void *arg) {
+    gen_worker_t *worker = arg;
+    const gen_options_t *opts = worker->opts;
+    size_t size = exam_buffer_size(opts);
+    char *buffer = malloc(size);
+    if (buffer == NULL) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    char path[4096];
+    for (long long n = worker->first; n < worker->last; n++) {
+        size_t length = render_exam(opts, n, buffer, size);
+        snprintf(path, sizeof(path), "%s/exam_%04lld.txt", opts->dir, n);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || write_all(fd, buffer, length, -1) == -1) {
+            perror(path);
+            if (fd != -1) {
+                close(fd);
+            }
+            worker->failed = 1;
+            break;
+        }
+        close(fd);
+        worker->bytes += (long long)length;
+    }
+    free(buffer);
+    return NULL;
+}
+
+// Packed record header for exam number n
+static int record_header(char *buffer, size_t size, long long n, size_t length) {
+    return snprintf(buffer, size, "@ exam_%04lld.txt %zu\n", n, length);
+}
+
+// Packed mode runs twice over the chunks: first to size them, then (once every chunk's
+// offset is known) to render them again and pwrite them into place. Rendering is much
+// cheaper than the write, and it keeps memory bounded to one chunk per thread.
+static void *packed_worker(void *arg) {
+    gen_worker_t *worker = arg;
+    const gen_options_t *opts = worker->opts;
+    long long total = opts->count + (opts->terminator ? 1 : 0);
+    int sizing = worker->chunk_offset == NULL;
+
+    size_t exam_size = exam_buffer_size(opts);
+    char *exam = malloc(exam_size);
+    char *chunk = sizing ? NULL : malloc(PACK_CHUNK * (exam_size + 64));
+    if (exam == NULL || (!sizing && chunk == NULL)) {
+        free(exam);
+        free(chunk);
+        worker->failed = 1;
+        return NULL;
+    }
+
+    long long c;
+    while ((c = __atomic_fetch_add(worker->next_chunk, 1, __ATOMIC_RELAXED)) < worker->num_chunks) {
+        long long first = c * PACK_CHUNK + 1;
+        long long last = first + PACK_CHUNK < total + 1 ? first + PACK_CHUNK : total + 1;
+        size_t used = 0;
+        char header[64];
+        for (long long n = first; n < last; n++) {
+            size_t length = render_exam(opts, n, exam, exam_size);
+            int header_length = record_header(header, sizeof(header), n, length);
+            if (!sizing) {
+                memcpy(chunk + used, header, header_length);
+                memcpy(chunk + used + header_length, exam, length);
+            }
+            used += header_length + length;
+        }
+
+        if (sizing) {
+            worker->chunk_bytes[c] = (long long)used;
+        } else if (write_all(worker->fd, chunk, used, (off_t)worker->chunk_offset[c]) == -1) {
+            perror(opts->packed);
+            worker->failed = 1;
+            break;
+        } else {
+            worker->bytes += (long long)used;
+        }
+    }
+    free(exam);
+    free(chunk);
+    return NULL;
+}
+
+static int run_workers(gen_worker_t *workers, int threads, void *(*body)(void *)) {
+    pthread_t tids[threads];
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, body, &workers[t]) != 0) {
+            perror("pthread_create failed");
+            break;
+        }
+        started++;
+    }
+    int failed = started < threads;
+    for (int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+        failed |= workers[t].failed;
+    }
+    return failed ? -1 : 0;
+}
+
+// Layout: "TAPACK <version> <exams> <questions>\n", then for every exam a record header
+// "@ exam_NNNN.txt <length>\n" followed by exactly <length> bytes of the exam file's contents
+static long long write_packed(const gen_options_t *opts, gen_worker_t *workers) {
+    long long total = opts->count + (opts->terminator ? 1 : 0);
+    long long num_chunks = (total + PACK_CHUNK - 1) / PACK_CHUNK;
+    int fd = open(opts->packed, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(opts->packed);
+        return -1;
+    }
+
+    char header[128];
+    int header_length = snprintf(header, sizeof(header), "%s %d %lld %d\n", PACK_MAGIC, PACK_VERSION,
+                                 total, opts->questions);
+    long long *chunk_bytes = calloc((size_t)num_chunks + 1, sizeof(long long));
+    long long *chunk_offset = calloc((size_t)num_chunks + 1, sizeof(long long));
+    if (chunk_bytes == NULL || chunk_offset == NULL || write_all(fd, header, header_length, 0) == -1) {
+        perror("Failed to start packed file");
+        free(chunk_bytes);
+        free(chunk_offset);
+        close(fd);
+        return -1;
+    }
+
+    long long next_chunk = 0;
+    for (int t = 0; t < opts->threads; t++) {
+        workers[t].fd = fd;
+        workers[t].chunk_bytes = chunk_bytes;
+        workers[t].chunk_offset = NULL;
+        workers[t].num_chunks = num_chunks;
+        workers[t].next_chunk = &next_chunk;
+    }
+    int result = run_workers(workers, opts->threads, packed_worker);
+
+    if (result == 0) {
+        long long offset = header_length;
+        for (long long c = 0; c < num_chunks; c++) {
+            chunk_offset[c] = offset;
+            offset += chunk_bytes[c];
+        }
+        if (ftruncate(fd, offset) == -1) {
+            perror("ftruncate failed");  // Only a preallocation hint
+        }
+        for (int t = 0; t < opts->threads; t++) {
+            workers[t].chunk_offset = chunk_offset;
+        }
+        next_chunk = 0;
+        result = run_workers(workers, opts->threads, packed_worker);
+    }
+
+    free(chunk_bytes);
+    free(chunk_offset);
+    if (close(fd) == -1) {
+        perror(opts->packed);
+        result = -1;
+    }
+    if (result == -1) {
+        return -1;
+    }
+    long long bytes = header_length;
+    for (int t = 0; t < opts->threads; t++) {
+        bytes += workers[t].bytes;
+    }
+    return bytes;
+}
+
+static long long write_files(const gen_options_t *opts, gen_worker_t *workers) {
+    long long total = opts->count + (opts->terminator ? 1 : 0);
+    for (int t = 0; t < opts->threads; t++) {
+        workers[t].first = 1 + total * t / opts->threads;
+        workers[t].last = 1 + total * (t + 1) / opts->threads;
+    }
+    if (run_workers(workers, opts->threads, per_file_worker) == -1) {
+        return -1;
+    }
+    long long bytes = 0;
+    for (int t = 0; t < opts->threads; t++) {
+        bytes += workers[t].bytes;
+    }
+    return bytes;
+}
+
+// rubric.txt in the "<line>, <answer letter>" format Part B reads
+static int write_rubric(const gen_options_t *opts) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/rubric.txt", opts->dir);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 1; i <= opts->rubric_lines; i++) {
+        fprintf(file, "%d, %c\n", i, 'A' + (i - 1) % 26);
+    }
+    if (fclose(file) == EOF) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *program) {
+    printf("Usage: %s [count] [--questions=N] [--answer-bytes=N] [--ids=sequential|uniform|zipf]\n"
+           "       [--seed=N] [--threads=N] [--dir=DIR] [--packed=FILE] [--rubric=LINES] [--no-terminator]\n",
+           program);
+    exit(1);
+}
+
+static void parse_options(int argc, char *argv[], gen_options_t *opts) {
+    opts->count = 19;
+    opts->questions = 5;
+    opts->answer_bytes = 200;
+    opts->ids = IDS_SEQUENTIAL;
+    opts->seed = 1;
+    opts->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    opts->terminator = 1;
+    opts->dir = ".";
+    opts->packed = NULL;
+    opts->rubric_lines = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--questions=", 12) == 0) {
+            opts->questions = atoi(arg + 12);
+        } else if (strncmp(arg, "--answer-bytes=", 15) == 0) {
+            opts->answer_bytes = atoi(arg + 15);
+        } else if (strcmp(arg, "--ids=sequential") == 0) {
+            opts->ids = IDS_SEQUENTIAL;
+        } else if (strcmp(arg, "--ids=uniform") == 0) {
+            opts->ids = IDS_UNIFORM;
+        } else if (strcmp(arg, "--ids=zipf") == 0) {
+            opts->ids = IDS_ZIPF;
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            opts->seed = strtoull(arg + 7, NULL, 10);
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            opts->threads = atoi(arg + 10);
+        } else if (strncmp(arg, "--dir=", 6) == 0) {
+            opts->dir = arg + 6;
+        } else if (strncmp(arg, "--packed=", 9) == 0) {
+            opts->packed = arg + 9;
+        } else if (strncmp(arg, "--rubric=", 9) == 0) {
+            opts->rubric_lines = atoi(arg + 9);
+        } else if (strcmp(arg, "--no-terminator") == 0) {
+            opts->terminator = 0;
+        } else if (arg[0] != '-' && atoll(arg) >= 0) {
+            opts->count = atoll(arg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (opts->questions < 1 || opts->answer_bytes < 0 || opts->answer_bytes > MAX_ANSWER_BYTES ||
+        opts->rubric_lines < 0 || (opts->count == 0 && !opts->terminator)) {
+        usage(argv[0]);
+    }
+    if (opts->threads < 1) {
+        opts->threads = 1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    gen_options_t opts;
+    parse_options(argc, argv, &opts);
+
+    if (mkdir(opts.dir, 0755) == -1 && errno != EEXIST) {
+        perror(opts.dir);
+        exit(1);
+    }
+    if (opts.rubric_lines > 0 && write_rubric(&opts) == -1) {
+        exit(1);
+    }
+
+    gen_worker_t *workers = calloc((size_t)opts.threads, sizeof(gen_worker_t));
+    if (workers == NULL) {
+        perror("calloc failed");
+        exit(1);
+    }
+    for (int t = 0; t < opts.threads; t++) {
+        workers[t].opts = &opts;
+        workers[t].fd = -1;
+    }
+
+    long long start = monotonic_us();
+    long long bytes = opts.packed != NULL ? write_packed(&opts, workers) : write_files(&opts, workers);
+    long long elapsed = monotonic_us() - start;
+    free(workers);
+    if (bytes == -1) {
+        exit(1);
+    }
+
+    long long total = opts.count + (opts.terminator ? 1 : 0);
+    double seconds = elapsed > 0 ? elapsed / 1e6 : 1e-6;
+    printf("Generated %lld exams (%d questions, %.1f MB) %s %s in %.2fs = %.0f exams/s, %.1f MB/s, %d thread(s)\n",
+           total, opts.questions, bytes / 1e6, opts.packed != NULL ? "packed into" : "under",
+           opts.packed != NULL ? opts.packed : opts.dir, seconds, total / seconds, bytes / 1e6 / seconds,
+           opts.threads);
+    if (opts.rubric_lines > 0) {
+        printf("Wrote %s/rubric.txt with %d lines\n", opts.dir, opts.rubric_lines);
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+# Sourced by the benchmark and stress scripts. Every run rewrites rubric.txt, so it is saved
+# once here: restore_rubric puts it back before each run, and the EXIT trap puts it back at
+# the end. Temporary files appended to cleanup_files are removed on exit as well.
+rubric_backup=$(mktemp)
+cp rubric.txt "$rubric_backup"
+cleanup_files=("$rubric_backup")
+trap 'cp "$rubric_backup" rubric.txt; rm -f "${cleanup_files[@]}"' EXIT
+
+restore_rubric() {
+    cp "$rubric_backup" rubric.txt
+}
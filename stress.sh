@@ -0,0 +1,45 @@
+#!/bin/bash
+# Schedule-perturbation stress test: many short seeded runs with random yields and delays at
+# every lock and semaphore operation (--chaos), a watchdog for hangs, and the end-of-run
+# invariant check. Every run's TA count, mode and injected faults are derived from its seed, so
+# rerunning the command a failure prints reproduces its fault schedule (the interleaving of the
+# TAs still varies from run to run).
+# Usage: ./stress.sh [runs] [max_tas]   (default: 200 runs, up to 64 TAs)
+# SEED (default 1) is the first seed; TIME_SCALE (default 0.002) shortens every delay
+runs=${1:-200}
+max_tas=${2:-64}
+first_seed=${SEED:-1}
+time_scale=${TIME_SCALE:-0.002}
+log=$(mktemp)
+source "$(dirname "$0")/rubric_guard.sh"
+cleanup_files+=("$log")
+failures=0
+
+for ((i = 0; i < runs; i++)); do
+    seed=$((first_seed + i))
+    RANDOM=$seed
+    tas=$((2 + RANDOM % (max_tas - 1)))
+    case $((RANDOM % 6)) in
+        0) mode="" ;;
+        1) mode="--lock=ticket" ;;
+        2) mode="--pipeline" ;;
+        3) mode="--pipeline --speculate --lock=ticket" ;;
+        4) mode="--teams=$((2 + RANDOM % 7))" ;;
+        5) mode="--speed-aware" ;;
+    esac
+    cmd="./ta_partB $tas $mode --chaos=$seed --watchdog=10 --time-scale=$time_scale"
+
+    restore_rubric
+    timeout 300 $cmd > "$log" 2>&1
+    status=$?
+    if [ $status -ne 0 ]; then
+        failures=$((failures + 1))
+        echo "FAIL (exit $status) seed $seed: $cmd"
+        grep -E "Invariant|Watchdog|  TA " "$log" | head -20
+    elif (( (i + 1) % 20 == 0 )); then
+        echo "$((i + 1))/$runs runs passed"
+    fi
+done
+
+echo "$((runs - failures))/$runs runs passed"
+[ $failures -eq 0 ]
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ta_daemon.h"
+
+#define BUSY_POLL_MS 1      // Socket wait while a batch runs, so completion is noticed quickly
+#define IDLE_POLL_MS 50     // Between batches (still often enough to recover dead TAs)
+
+typedef struct {
+    int fd;                         // -1: free slot
+    char line[DAEMON_LINE_LENGTH];  // Partial request line
+    size_t used;
+} client_t;
+
+typedef struct {
+    int fd;                         // Client to report to (-1 once it has gone away)
+    int exams;
+    char dir[MAX_PATH_LENGTH];
+} batch_request_t;
+
+typedef struct {
+    ta_engine_t *engine;
+    int listener;
+    client_t clients[DAEMON_MAX_CLIENTS];
+    batch_request_t queue[DAEMON_QUEUE_SIZE];   // Ring indexed by the counters below
+    int queue_head;
+    int queue_tail;
+    batch_request_t running;        // Batch being marked (fd -1 if its client left)
+    int busy;
+    int batch;
+    long long batch_start_us;
+    int stopping;
+    engine_progress_t progress;     // As of the last supervision pass
+} daemon_t;
+
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Best effort: a client that stopped reading must not block or kill (SIGPIPE) the daemon
+static void reply(int fd, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void reply(int fd, const char *format, ...) {
+    if (fd < 0) {
+        return;
+    }
+    char line[DAEMON_LINE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if (length > (int)sizeof(line) - 2) {
+        length = sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+    send(fd, line, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+static int fill_address(struct sockaddr_un *address, const char *socket_path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        printf("Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+static int connect_daemon(const char *socket_path) {
+    struct sockaddr_un address;
+    if (fill_address(&address, socket_path) == -1) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket failed");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un address;
+    if (fill_address(&address, socket_path) == -1) {
+        return -1;
+    }
+
+    // A socket file nobody answers on is left over from a daemon that crashed
+    int other = connect_daemon(socket_path);
+    if (other != -1) {
+        close(other);
+        printf("A daemon is already listening on %s\n", socket_path);
+        return -1;
+    }
+    unlink(socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        perror("socket failed");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, DAEMON_MAX_CLIENTS) == -1) {
+        perror("Failed to listen on the daemon socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void handle_request(daemon_t *daemon, int fd, char *line) {
+    const engine_progress_t *progress = &daemon->progress;
+    if (strncmp(line, "MARK ", 5) == 0) {
+        char *dir = NULL;
+        long exams = strtol(line + 5, &dir, 10);
+        while (dir != NULL && *dir == ' ') {
+            dir++;
+        }
+        if (dir == NULL || *dir != '/' || exams < 1 || exams > MAX_EXAMS || strlen(dir) >= MAX_PATH_LENGTH) {
+            reply(fd, "FAILED expected MARK <1-%d> <absolute dir>", MAX_EXAMS);
+        } else if (daemon->stopping) {
+            reply(fd, "FAILED daemon is stopping");
+        } else if (daemon->queue_head - daemon->queue_tail == DAEMON_QUEUE_SIZE) {
+            reply(fd, "FAILED queue full");
+        } else {
+            batch_request_t *request = &daemon->queue[daemon->queue_head++ % DAEMON_QUEUE_SIZE];
+            request->fd = fd;
+            request->exams = (int)exams;
+            strcpy(request->dir, dir);
+            reply(fd, "QUEUED %d", daemon->queue_head - daemon->queue_tail + daemon->busy);
+        }
+    } else if (strcmp(line, "STATUS") == 0) {
+        reply(fd, "STATUS batch=%d state=%s queued=%d tas=%d exams=%d/%d", progress->batch_id,
+              daemon->stopping ? "stopping" : daemon->busy ? "marking" : "idle",
+              daemon->queue_head - daemon->queue_tail, progress->active_tas,
+              progress->exams_completed, progress->total_exams);
+    } else if (strcmp(line, "STOP") == 0) {
+        daemon->stopping = 1;
+        engine_stop(daemon->engine);
+        reply(fd, "STOPPING");
+    } else {
+        reply(fd, "ERROR unknown request (MARK, STATUS or STOP)");
+    }
+}
+
+// Forget a client: its queued batches still run, nobody is told about them
+static void drop_client(daemon_t *daemon, client_t *client) {
+    for (int n = daemon->queue_tail; n < daemon->queue_head; n++) {
+        if (daemon->queue[n % DAEMON_QUEUE_SIZE].fd == client->fd) {
+            daemon->queue[n % DAEMON_QUEUE_SIZE].fd = -1;
+        }
+    }
+    if (daemon->running.fd == client->fd) {
+        daemon->running.fd = -1;
+    }
+    close(client->fd);
+    client->fd = -1;
+}
+
+static void read_client(daemon_t *daemon, client_t *client) {
+    ssize_t n = recv(client->fd, client->line + client->used, sizeof(client->line) - 1 - client->used,
+                     MSG_DONTWAIT);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        drop_client(daemon, client);
+        return;
+    }
+    client->used += (size_t)n;
+    client->line[client->used] = '\0';
+
+    char *newline;
+    while ((newline = strchr(client->line, '\n')) != NULL) {
+        *newline = '\0';
+        if (newline > client->line && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        handle_request(daemon, client->fd, client->line);
+        size_t rest = client->used - (size_t)(newline + 1 - client->line);
+        memmove(client->line, newline + 1, rest + 1);
+        client->used = rest;
+    }
+    if (client->used == sizeof(client->line) - 1) {
+        reply(client->fd, "ERROR request too long");
+        drop_client(daemon, client);
+    }
+}
+
+static void accept_clients(daemon_t *daemon) {
+    int fd;
+    while ((fd = accept4(daemon->listener, NULL, NULL, SOCK_CLOEXEC)) != -1) {
+        client_t *slot = NULL;
+        for (int i = 0; i < DAEMON_MAX_CLIENTS && slot == NULL; i++) {
+            if (daemon->clients[i].fd == -1) {
+                slot = &daemon->clients[i];
+            }
+        }
+        if (slot == NULL) {
+            reply(fd, "FAILED too many clients");
+            close(fd);
+            continue;
+        }
+        slot->fd = fd;
+        slot->used = 0;
+    }
+}
+
+// Report a finished batch and start the next queued one
+static void advance_batches(daemon_t *daemon) {
+    engine_progress_t progress;
+    if (daemon->busy && engine_batch_done(daemon->engine)) {
+        engine_poll(daemon->engine, &progress);
+        long long elapsed_ms = (monotonic_us() - daemon->batch_start_us) / 1000;
+        printf("Daemon: batch %d done: %d/%d exams, %lld questions in %lldms (%s)\n", daemon->batch,
+               progress.exams_completed, progress.total_exams, progress.questions_marked, elapsed_ms,
+               daemon->running.dir);
+        reply(daemon->running.fd, "DONE %d exams=%d/%d questions=%lld elapsed_ms=%lld", daemon->batch,
+              progress.exams_completed, progress.total_exams, progress.questions_marked, elapsed_ms);
+        daemon->busy = 0;
+    }
+
+    while (!daemon->busy && !daemon->stopping && daemon->queue_tail < daemon->queue_head) {
+        daemon->running = daemon->queue[daemon->queue_tail++ % DAEMON_QUEUE_SIZE];
+        daemon->batch_start_us = monotonic_us();
+        int batch = engine_begin_batch(daemon->engine, daemon->running.dir, daemon->running.exams);
+        long long setup_us = monotonic_us() - daemon->batch_start_us;
+        if (batch == -1) {
+            reply(daemon->running.fd, "FAILED cannot start a batch from %s", daemon->running.dir);
+            continue;
+        }
+        daemon->batch = batch;
+        daemon->busy = 1;
+        printf("Daemon: batch %d started from %s (%d exams, setup %lldus)\n", batch, daemon->running.dir,
+               daemon->running.exams, setup_us);
+        reply(daemon->running.fd, "STARTED %d setup_us=%lld", batch, setup_us);
+    }
+}
+
+int daemon_serve(ta_engine_t *engine, const char *socket_path) {
+    // Batches change the working directory, so remember where the socket is
+    char path[2 * PATH_MAX];
+    if (socket_path[0] == '/') {
+        snprintf(path, sizeof(path), "%s", socket_path);
+    } else {
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            perror("getcwd failed");
+            return -1;
+        }
+        snprintf(path, sizeof(path), "%s/%s", cwd, socket_path);
+    }
+
+    static daemon_t daemon;
+    memset(&daemon, 0, sizeof(daemon));
+    daemon.engine = engine;
+    daemon.running.fd = -1;
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        daemon.clients[i].fd = -1;
+    }
+    daemon.listener = open_listener(path);
+    if (daemon.listener == -1) {
+        return -1;
+    }
+    printf("Daemon: listening on %s\n", path);
+    fflush(stdout);
+
+    while (engine_poll(engine, &daemon.progress) > 0) {
+        if (daemon.progress.shutdown_requested) {
+            daemon.stopping = 1;  // A signal or STOP: queued batches are not started
+        }
+        advance_batches(&daemon);
+        fflush(stdout);
+
+        struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+        client_t *owners[DAEMON_MAX_CLIENTS + 1];
+        int count = 0;
+        fds[count].fd = daemon.listener;
+        fds[count].events = POLLIN;
+        owners[count++] = NULL;
+        for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+            if (daemon.clients[i].fd != -1) {
+                fds[count].fd = daemon.clients[i].fd;
+                fds[count].events = POLLIN;
+                owners[count++] = &daemon.clients[i];
+            }
+        }
+        if (poll(fds, count, daemon.busy ? BUSY_POLL_MS : IDLE_POLL_MS) <= 0) {
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            accept_clients(&daemon);
+        }
+        for (int i = 1; i < count; i++) {
+            if (fds[i].revents != 0 && owners[i]->fd != -1) {
+                read_client(&daemon, owners[i]);
+            }
+        }
+    }
+
+    // Every TA has exited: nothing queued will run
+    if (daemon.busy) {
+        reply(daemon.running.fd, "FAILED daemon stopped during batch %d", daemon.batch);
+    }
+    for (int n = daemon.queue_tail; n < daemon.queue_head; n++) {
+        reply(daemon.queue[n % DAEMON_QUEUE_SIZE].fd, "FAILED daemon stopped");
+    }
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+        if (daemon.clients[i].fd != -1) {
+            close(daemon.clients[i].fd);
+        }
+    }
+    close(daemon.listener);
+    unlink(path);
+    printf("Daemon: stopped after %d batch(es)\n", daemon.batch);
+    return 0;
+}
+
+// Print reply lines until one starts with any of the given words (NULL-terminated), or EOF
+static int read_replies(int fd, const char *const *final) {
+    char buffer[DAEMON_LINE_LENGTH];
+    size_t used = 0;
+    while (1) {
+        ssize_t n = recv(fd, buffer + used, sizeof(buffer) - 1 - used, 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        used += (size_t)n;
+        buffer[used] = '\0';
+
+        char *newline;
+        while ((newline = strchr(buffer, '\n')) != NULL) {
+            *newline = '\0';
+            printf("%s\n", buffer);
+            fflush(stdout);
+            for (int i = 0; final[i] != NULL; i++) {
+                if (strncmp(buffer, final[i], strlen(final[i])) == 0) {
+                    return i;
+                }
+            }
+            used -= (size_t)(newline + 1 - buffer);
+            memmove(buffer, newline + 1, used + 1);
+        }
+        if (used == sizeof(buffer) - 1) {
+            used = 0;  // Overlong line: drop it
+        }
+    }
+}
+
+static int send_line(int fd, const char *line) {
+    size_t length = strlen(line);
+    return send(fd, line, length, MSG_NOSIGNAL) == (ssize_t)length ? 0 : -1;
+}
+
+int daemon_submit(const char *socket_path, const char *dir, int exams) {
+    char resolved[PATH_MAX];
+    if (realpath(dir, resolved) == NULL) {
+        perror(dir);
+        return -1;
+    }
+    int fd = connect_daemon(socket_path);
+    if (fd == -1) {
+        printf("No daemon is listening on %s\n", socket_path);
+        return -1;
+    }
+
+    char request[DAEMON_LINE_LENGTH + PATH_MAX];
+    snprintf(request, sizeof(request), "MARK %d %s\n", exams, resolved);
+    static const char *const final[] = {"DONE", "FAILED", "ERROR", NULL};
+    int result = send_line(fd, request) == 0 ? read_replies(fd, final) : -1;
+    close(fd);
+    return result == 0 ? 0 : -1;
+}
+
+int daemon_control(const char *socket_path, const char *command) {
+    int fd = connect_daemon(socket_path);
+    if (fd == -1) {
+        printf("No daemon is listening on %s\n", socket_path);
+        return -1;
+    }
+    char request[64];
+    snprintf(request, sizeof(request), "%s\n", command);
+    static const char *const final[] = {"STATUS", "STOPPING", "ERROR", NULL};
+    int result = send_line(fd, request) == 0 ? read_replies(fd, final) : -1;
+    close(fd);
+    return result >= 0 && result < 2 ? 0 : -1;
+}
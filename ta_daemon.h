@@ -0,0 +1,32 @@
+#ifndef TA_DAEMON_H
+#define TA_DAEMON_H
+
+#include "ta_engine.h"
+
+// Daemon mode: a started daemon engine (opts.daemon) serves batches over a Unix-domain
+// socket, so the TA pool, semaphores and segment are set up once for many batches.
+//
+// Line protocol, one request per line:
+//   MARK <exams> <dir>   queue exams 1..<exams> of <dir> (absolute path, with its rubric.txt)
+//                        -> QUEUED <position>, then STARTED <batch> setup_us=<n>,
+//                           then DONE <batch> exams=<done>/<total> questions=<n> elapsed_ms=<n>
+//                           (or FAILED <reason>)
+//   STATUS               -> STATUS batch=<n> state=idle|marking|stopping queued=<n> tas=<n> exams=<done>/<total>
+//   STOP                 -> STOPPING; the TAs finish the batch in hand and the daemon exits
+
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_QUEUE_SIZE 64        // Batches waiting for the pool
+#define DAEMON_LINE_LENGTH 512
+
+// Serve batches until a STOP request or a signal drains the engine. Returns 0, or -1 if the
+// socket could not be set up.
+int daemon_serve(ta_engine_t *engine, const char *socket_path);
+
+// Client: submit one batch and print the daemon's replies until it finishes. Returns 0 if
+// the batch completed.
+int daemon_submit(const char *socket_path, const char *dir, int exams);
+
+// Client: send STATUS or STOP and print the reply, -1 if the daemon cannot be reached
+int daemon_control(const char *socket_path, const char *command);
+
+#endif
@@ -0,0 +1,3403 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <sys/sem.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <sys/inotify.h>
+
+#include "ta_engine.h"
+#include "ta_lock.h"
+#include "ta_grades.h"
+#include "ta_slab.h"
+
+// Semaphore operations
+union semun {
+    int val;
+    struct semid_ds *buf;
+    unsigned short *array;
+};
+
+// Status slot of the calling TA (NULL in the parent), published for ta_stat
+static ta_status_t *my_status = NULL;
+
+#define RUBRIC_FILE "rubric.txt"
+
+// The question this TA marked last, stored with the mark by record_mark
+static char last_feedback[2 * MAX_LINE_LENGTH];
+static long last_words = 0;
+
+// Exam catalog filled by --ingest (NULL: every exam is read from its file on demand)
+static shared_data_t *ingested = NULL;
+
+// Segments of the run: one per course of a sharded run (--shards), otherwise just the
+// engine's own. Filled by engine_create before any TA is forked, so every TA inherits them.
+typedef struct {
+    ipc_run_t ipc_run;          // Shard 0 uses the engine's
+    int semid;
+    shared_data_t *shared_data;
+    int dir_fd;                 // Course directory (-1: the working directory)
+    int watch_wd;               // inotify watch on the course directory (-1 if none)
+    int rubric_pending;         // Parent: an outside rubric edit waits to be merged or published
+} shard_t;
+
+static shard_t shards[MAX_SHARDS];
+static int num_shards = 1;
+static int home_dir_fd = -1;    // Parent: working directory to return to after visiting a course
+
+// Copied from the options by engine_create, so every TA forked later inherits them.
+// --time-scale: multiplies every simulated delay (marking, rubric review, loop pauses)
+static double time_scale = 1.0;
+
+// --chaos=SEED: stress testing. Every semaphore and lock operation may first yield or sleep
+// briefly, driven by a per-TA generator seeded from SEED, to shake out rare interleavings.
+static int chaos = 0;
+static unsigned int chaos_seed = 0;
+static unsigned int chaos_state = 0;
+
+// SIGINT/SIGTERM received by the parent (how many, so a second one can force the exit)
+static volatile sig_atomic_t stop_signals = 0;
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Milliseconds since the run started
+static long long run_time_ms(shared_data_t *shared_data) {
+    return monotonic_ms() - shared_data->start_time_ms;
+}
+
+// Simulated work or a pause between steps, scaled by --time-scale
+static void pause_ms(int ms) {
+    usleep((useconds_t)(ms * time_scale * 1000));
+}
+
+// TAs stop taking new work once the batch is done or a shutdown was requested
+static int stop_requested(const shared_data_t *shared_data) {
+    return shared_data->exams_finished || shared_data->shutdown_requested;
+}
+
+// Publish what this TA is doing so monitors can see it without taking any lock
+static void set_ta_state(ta_state_t state) {
+    if (my_status != NULL) {
+        // Charge the time spent in the previous state to busy or idle (read by the supervisor)
+        long long now = monotonic_ms();
+        long long spent = now - my_status->state_since_ms;
+        int previous = my_status->state;
+        if (previous == TA_LOADING_EXAM || previous == TA_CHECKING_RUBRIC || previous == TA_MARKING) {
+            my_status->busy_ms += spent;
+        } else {
+            my_status->idle_ms += spent;
+        }
+        my_status->state_since_ms = now;
+        my_status->state = state;
+
+        // Track scheduler migrations so cross-socket bouncing shows up in the summary
+        int cpu = sched_getcpu();
+        if (my_status->cpu != cpu && my_status->cpu != -1) {
+            my_status->migrations++;
+        }
+        my_status->cpu = cpu;
+    }
+}
+
+// Chaos injection point: usually nothing, sometimes a yield, occasionally a short sleep
+static void chaos_point(void) {
+    if (!chaos) {
+        return;
+    }
+    int roll = rand_r(&chaos_state) % 100;
+    if (roll < 20) {
+        sched_yield();
+    } else if (roll < 25) {
+        usleep(rand_r(&chaos_state) % 2000);
+    }
+}
+
+// Semaphore operations
+// Mutex semaphores get SEM_UNDO so the kernel releases them if their holder dies.
+// Counting semaphores must not: one process produces the tokens another consumes.
+static short sem_undo_flag(int sem_num) {
+    return (sem_num == SEM_RUBRIC || sem_num == SEM_QUESTIONS || sem_num == SEM_SHARED) ? SEM_UNDO : 0;
+}
+
+static void sem_wait(int semid, int sem_num) {
+    struct sembuf sb = {sem_num, -1, sem_undo_flag(sem_num)};
+    chaos_point();
+    if (my_status != NULL) {
+        my_status->waiting_sem = sem_num;
+    }
+    semop(semid, &sb, 1);
+    if (my_status != NULL) {
+        my_status->waiting_sem = -1;
+    }
+    chaos_point();  // Stretch the critical section
+}
+
+static void sem_signal(int semid, int sem_num) {
+    struct sembuf sb = {sem_num, 1, sem_undo_flag(sem_num)};
+    chaos_point();
+    semop(semid, &sb, 1);
+}
+
+// Non-blocking wait, -1 if the semaphore is not available right now
+static int sem_try_wait(int semid, int sem_num) {
+    struct sembuf sb = {sem_num, -1, sem_undo_flag(sem_num) | IPC_NOWAIT};
+    chaos_point();
+    return semop(semid, &sb, 1);
+}
+
+// Wait at most timeout_ms, -1 if the semaphore did not become available in time
+static int sem_wait_timeout(int semid, int sem_num, int timeout_ms) {
+    struct sembuf sb = {sem_num, -1, 0};
+    chaos_point();
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    if (my_status != NULL) {
+        my_status->waiting_sem = sem_num;
+    }
+    int result = semtimedop(semid, &sb, 1, &timeout);
+    if (my_status != NULL) {
+        my_status->waiting_sem = -1;
+    }
+    return result;
+}
+
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Take the shared-state lock (SEM_SHARED or the ticket lock) and record how long it took
+static void shared_lock(shared_data_t *shared_data, int semid) {
+    long long start = monotonic_us();
+    if (shared_data->lock_mode == LOCK_TICKET) {
+        if (my_status != NULL) {
+            my_status->waiting_sem = SEM_SHARED;
+        }
+        // Publish the ticket before blocking so the parent can recover it if we die
+        chaos_point();
+        unsigned int ticket = my_status != NULL
+            ? ticket_lock_take(&shared_data->shared_lock, my_status->pid, &my_status->lock_ticket, &my_status->has_ticket)
+            : ticket_lock_take(&shared_data->shared_lock, TICKET_ANONYMOUS, NULL, NULL);
+        ticket_lock_wait(&shared_data->shared_lock, ticket);
+        if (my_status != NULL) {
+            my_status->waiting_sem = -1;
+        }
+        chaos_point();
+    } else {
+        sem_wait(semid, SEM_SHARED);
+    }
+
+    // Only the holder gets here, and each TA writes its own slot
+    if (my_status != NULL) {
+        long long waited = monotonic_us() - start;
+        my_status->lock_acquisitions++;
+        my_status->lock_wait_us += waited;
+        if (waited > my_status->lock_max_wait_us) {
+            my_status->lock_max_wait_us = waited;
+        }
+    }
+}
+
+static void shared_unlock(shared_data_t *shared_data, int semid) {
+    if (shared_data->lock_mode == LOCK_TICKET) {
+        chaos_point();
+        ticket_lock_release(&shared_data->shared_lock);
+        if (my_status != NULL) {
+            my_status->has_ticket = 0;  // A stale ticket is harmless: it has already been served
+        }
+    } else {
+        sem_signal(semid, SEM_SHARED);
+    }
+}
+
+// Add count to a counting semaphore in one operation
+static void sem_signal_n(int semid, int sem_num, int count) {
+    if (count <= 0) {
+        return;
+    }
+    struct sembuf sb = {sem_num, (short)count, 0};
+    chaos_point();
+    semop(semid, &sb, 1);
+}
+
+// Read the rubric file into lines, returning how many lines it had (-1 if it cannot be opened)
+static int read_rubric_file(char lines[RUBRIC_SIZE][MAX_LINE_LENGTH]) {
+    FILE *file = fopen(RUBRIC_FILE, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int count = 0;
+    while (count < RUBRIC_SIZE && fgets(lines[count], MAX_LINE_LENGTH, file) != NULL) {
+        lines[count][strcspn(lines[count], "\n")] = 0;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Function to load rubric from file to shared memory
+static int load_rubric(shared_data_t *shared_data) {
+    if (read_rubric_file(shared_data->rubric) == -1) {
+        perror("Failed to open rubric file");
+        return -1;
+    }
+    memcpy(shared_data->rubric_on_disk, shared_data->rubric, sizeof(shared_data->rubric));
+    return 0;
+}
+
+// Rubric versions: every correction is published as a new immutable snapshot, and each exam
+// pins the version that was current when it was first loaded, so all of its questions are
+// marked against the same rubric. Markers never take the rubric lock. Old snapshots are
+// reclaimed epoch-style: when a new version is published, any snapshot that is not the
+// current one, not pinned by an exam still being marked and not announced by a TA is freed.
+
+// Is a rubric version still referenced by the current rubric, an unfinished exam or a TA?
+static int rubric_version_live(shared_data_t *shared_data, int version) {
+    if (version == __atomic_load_n(&shared_data->rubric_current, __ATOMIC_SEQ_CST)) {
+        return 1;
+    }
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        const exam_record_t *record = &shared_data->exam_records[i];
+        if (__atomic_load_n(&record->rubric_version, __ATOMIC_SEQ_CST) == version &&
+            __atomic_load_n(&record->questions_done, __ATOMIC_SEQ_CST) < RUBRIC_SIZE) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        if (__atomic_load_n(&shared_data->tas[i].rubric_pin, __ATOMIC_SEQ_CST) == version) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Publish shared_data->rubric as version rubric_version (caller holds SEM_QUESTIONS, which
+// serializes writers). Unreferenced snapshots are reclaimed first; if every slot is still in
+// use a TA waits for an exam to finish, markers are never held up. The parent passes wait = 0
+// instead, as it must keep recovering dead TAs (whose pins only recovery clears): returns -1
+// if nothing could be published yet.
+static int publish_rubric(shared_data_t *shared_data, int wait) {
+    int version = shared_data->rubric_version;
+    if (version == shared_data->rubric_current) {
+        return 0;
+    }
+
+    int free_slot = -1, live = 0;
+    while (!stop_requested(shared_data)) {
+        for (int i = 0; i < RUBRIC_HISTORY; i++) {
+            rubric_snapshot_t *snapshot = &shared_data->rubric_history[i];
+            if (snapshot->version >= 0 && rubric_version_live(shared_data, snapshot->version)) {
+                live++;
+                continue;
+            }
+            if (snapshot->version >= 0) {
+                __atomic_store_n(&snapshot->version, -1, __ATOMIC_SEQ_CST);
+                shared_data->rubric_reclaimed++;
+            }
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+        }
+        if (free_slot >= 0) {
+            break;
+        }
+        if (!wait) {
+            return -1;
+        }
+        live = 0;
+        pause_ms(10);
+    }
+    if (free_slot < 0) {
+        return 0;  // Shutting down: new exams keep pinning the previous version
+    }
+
+    // Readers check the version before and after copying, so the content is written while
+    // the slot is marked free and only then stamped with its version
+    rubric_snapshot_t *snapshot = &shared_data->rubric_history[free_slot];
+    memcpy(snapshot->lines, shared_data->rubric, sizeof(snapshot->lines));
+    __atomic_store_n(&snapshot->version, version, __ATOMIC_RELEASE);
+    __atomic_store_n(&shared_data->rubric_current, version, __ATOMIC_SEQ_CST);
+    shared_data->rubric_published++;
+    if (live + 1 > shared_data->rubric_max_live) {
+        shared_data->rubric_max_live = live + 1;
+    }
+    return 0;
+}
+
+// Pin an exam to a rubric version. The first load pins the current version in the exam's
+// record; any later load (a dead TA's exam handed out again) reuses that pin.
+static void pin_exam_rubric(shared_data_t *shared_data, exam_info_t *exam) {
+    exam->rubric_version = -1;
+    if (exam->student_id == 9999) {
+        return;  // The terminator is never marked, so it must not hold a version forever
+    }
+
+    exam_record_t *record = &shared_data->exam_records[exam->exam_index];
+    int version = __atomic_load_n(&record->rubric_version, __ATOMIC_SEQ_CST);
+    if (version < 0) {
+        // Announce the version before relying on it, and retry if it stopped being current
+        // meanwhile: a writer that reclaims after this point sees the announcement
+        int *pin = my_status != NULL ? &my_status->rubric_pin : NULL;
+        do {
+            version = __atomic_load_n(&shared_data->rubric_current, __ATOMIC_SEQ_CST);
+            if (pin != NULL) {
+                __atomic_store_n(pin, version, __ATOMIC_SEQ_CST);
+            }
+        } while (version != __atomic_load_n(&shared_data->rubric_current, __ATOMIC_SEQ_CST));
+
+        int unset = -1;
+        if (!__atomic_compare_exchange_n(&record->rubric_version, &unset, version, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            version = unset;  // Another TA pinned it first
+        }
+        if (pin != NULL) {
+            __atomic_store_n(pin, -1, __ATOMIC_SEQ_CST);
+        }
+    }
+    exam->rubric_version = version;
+}
+
+// Copy one question's line of a pinned rubric version without any lock, -1 if the version
+// is no longer held (only possible for a speculative copy of a question that already finished)
+static int read_pinned_rubric(shared_data_t *shared_data, int version, int question, char *line) {
+    int found = -1;
+    if (my_status != NULL) {
+        __atomic_store_n(&my_status->rubric_pin, version, __ATOMIC_SEQ_CST);
+    }
+    for (int i = 0; i < RUBRIC_HISTORY && found < 0; i++) {
+        rubric_snapshot_t *snapshot = &shared_data->rubric_history[i];
+        if (__atomic_load_n(&snapshot->version, __ATOMIC_ACQUIRE) != version) {
+            continue;
+        }
+        memcpy(line, snapshot->lines[question], MAX_LINE_LENGTH);
+        if (__atomic_load_n(&snapshot->version, __ATOMIC_SEQ_CST) == version) {
+            found = 0;
+        }
+    }
+    if (my_status != NULL) {
+        __atomic_store_n(&my_status->rubric_pin, -1, __ATOMIC_SEQ_CST);
+    }
+    return found;
+}
+
+// Store a mark with the rubric version it was given under, and add it to the grade statistics
+static void record_mark(shared_data_t *shared_data, const exam_info_t *exam, int question, int mark) {
+    exam_record_t *record = &shared_data->exam_records[exam->exam_index];
+    record->mark[question] = mark;
+    record->mark_rubric_version[question] = exam->rubric_version;
+
+    // The result record is sized to its feedback. A question marked again (its TA died, or a
+    // speculative copy won) frees the record it replaces.
+    size_t length = strlen(last_feedback) + 1;
+    slab_offset_t offset = slab_alloc(&shared_data->arena, &my_status->slab_cache, sizeof(mark_result_t) + length);
+    mark_result_t *result = slab_ptr(&shared_data->arena, offset);
+    if (result != NULL) {
+        result->ta_id = (int)(my_status - shared_data->tas) + 1;
+        result->mark = mark;
+        result->rubric_version = exam->rubric_version;
+        result->words = (int)last_words;
+        memcpy(result->feedback, last_feedback, length);
+    }
+    slab_offset_t replaced = __atomic_exchange_n(&record->result[question], offset, __ATOMIC_ACQ_REL);
+    slab_free(&shared_data->arena, &my_status->slab_cache, replaced);
+
+    __atomic_add_fetch(&record->mark_count[question], 1, __ATOMIC_RELAXED);
+    if (exam->rubric_version < __atomic_load_n(&shared_data->rubric_current, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&shared_data->rubric_older_marks, 1, __ATOMIC_RELAXED);
+    }
+    grades_record(my_status, question, mark);
+}
+
+// Read one exam file into an exam_info_t, -1 on failure.
+// Only the header and the section index are kept; the answer bodies stay in
+// the file and each TA maps just the section it marks.
+static int read_exam(int exam_index, exam_info_t *exam) {
+    // Already ingested in a batch at startup: no I/O at all
+    if (ingested != NULL && exam_index >= 0 && exam_index < MAX_EXAMS && ingested->catalog_ready[exam_index]) {
+        *exam = ingested->exam_catalog[exam_index];
+        return 0;
+    }
+
+    char filename[MAX_FILENAME_LENGTH];
+    exam_filename(filename, sizeof(filename), exam_index);
+    
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Failed to open exam file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        perror("Failed to read exam file");
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Failed to map exam file");
+        return -1;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    exam_parse(exam, data, size, exam_index);
+    munmap(data, size);
+    return 0;
+}
+
+// Exam index at a schedule position, -1 past the end of the schedule
+static int scheduled_exam(shared_data_t *shared_data, int position) {
+    if (position < 0 || position >= shared_data->total_exams) {
+        return -1;
+    }
+    return shared_data->schedule[position];
+}
+
+// Order used for the schedule: priority first, then earliest deadline, then file order
+static shared_data_t *schedule_data;
+
+static int compare_schedule(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    const exam_record_t *rx = &schedule_data->exam_records[x];
+    const exam_record_t *ry = &schedule_data->exam_records[y];
+    if (rx->priority != ry->priority) {
+        return ry->priority - rx->priority;
+    }
+    long long dx = rx->deadline_ms ? rx->deadline_ms : LLONG_MAX;
+    long long dy = ry->deadline_ms ? ry->deadline_ms : LLONG_MAX;
+    if (dx != dy) {
+        return dx < dy ? -1 : 1;
+    }
+    return x - y;
+}
+
+// Read the exam manifest: one "<exam> <priority> [deadline_seconds|-]" line per exam,
+// where <exam> is a file name (exam_0007.txt) or number (7). Unlisted exams keep
+// priority 0 and no deadline. Returns -1 on a malformed manifest.
+static int load_manifest(shared_data_t *shared_data, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("Failed to open exam manifest");
+        return -1;
+    }
+
+    char line[256];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        char exam[MAX_FILENAME_LENGTH], deadline[32] = "-";
+        int priority;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (sscanf(line, "%63s %d %31s", exam, &priority, deadline) < 2 || priority < 0) {
+            printf("Manifest line %d: expected \"<exam> <priority >= 0> [deadline_seconds]\"\n", line_number);
+            fclose(file);
+            return -1;
+        }
+
+        int number = 0;
+        if (sscanf(exam, "exam_%d.txt", &number) != 1) {
+            number = atoi(exam);
+        }
+        if (number < 1 || number > shared_data->total_exams) {
+            printf("Manifest line %d: no exam %s in this batch\n", line_number, exam);
+            fclose(file);
+            return -1;
+        }
+
+        exam_record_t *record = &shared_data->exam_records[number - 1];
+        record->priority = priority;
+        record->deadline_ms = strcmp(deadline, "-") == 0 ? 0 : (long long)(atof(deadline) * 1000);
+    }
+    fclose(file);
+    return 0;
+}
+
+// Whether an exam file is the 9999 terminator (only its header line is read; a missing
+// file is not, and is reported when a TA gets to it)
+static int exam_is_terminator(int exam_index) {
+    char filename[MAX_FILENAME_LENGTH];
+    exam_filename(filename, sizeof(filename), exam_index);
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int student_id = 0;
+    int found = fscanf(file, "%d", &student_id) == 1 && student_id == 9999;
+    fclose(file);
+    return found;
+}
+
+// Build the schedule once at startup. Dequeuing is then a single atomic increment
+// of current_exam_index, so no TA needs a lock just to pick the next exam.
+// The 9999 terminator goes after every real exam whatever the manifest gives it, or the
+// run would end before the exams scheduled behind it were marked.
+static void build_schedule(shared_data_t *shared_data) {
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        shared_data->schedule[i] = i;
+    }
+    schedule_data = shared_data;
+    qsort(shared_data->schedule, shared_data->total_exams, sizeof(int), compare_schedule);
+
+    int terminators[MAX_EXAMS], num_terminators = 0, kept = 0;
+    for (int position = 0; position < shared_data->total_exams; position++) {
+        int exam_index = shared_data->schedule[position];
+        if (exam_is_terminator(exam_index)) {
+            shared_data->exam_records[exam_index].terminator = 1;
+            terminators[num_terminators++] = exam_index;
+        } else {
+            shared_data->schedule[kept++] = exam_index;
+        }
+    }
+    memcpy(&shared_data->schedule[kept], terminators, num_terminators * sizeof(int));
+}
+
+// Make an exam the current one for classic TAs: pin its rubric version, record when it was
+// loaded and clear the per-question claims (caller holds the shared-state lock)
+static void load_exam_file(shared_data_t *shared_data, int exam_index) {
+    if (read_exam(exam_index, &shared_data->current_exam) == -1) {
+        return;
+    }
+    pin_exam_rubric(shared_data, &shared_data->current_exam);
+    shared_data->exam_records[exam_index].loaded_ms = run_time_ms(shared_data);
+    
+    // Reset questions marked for new exam
+    for (int i = 0; i < RUBRIC_SIZE; i++) {
+        shared_data->questions_marked[i] = 0;
+    }
+    
+    const exam_record_t *record = &shared_data->exam_records[exam_index];
+    printf("\nTA loaded exam: %s (Student ID: %d, priority %d", shared_data->current_exam.file,
+           shared_data->current_exam.student_id, record->priority);
+    if (record->deadline_ms > 0) {
+        printf(", due at %.1fs", record->deadline_ms / 1000.0);
+    }
+    printf(")\n\n");
+}
+
+// Map only the pages that hold one answer section and count its words, -1 on failure
+static long read_answer_section(const char *filename, long offset, long length) {
+    if (offset < 0 || length <= 0) {
+        return 0;  // Question left blank (or a header-only exam)
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // mmap offsets must be page aligned
+    long page = sysconf(_SC_PAGESIZE);
+    long map_start = offset - offset % page;
+    size_t map_length = (size_t)(offset - map_start + length);
+    char *map = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, map_start);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const char *answer = map + (offset - map_start);
+    long words = 0;
+    int in_word = 0;
+    for (long i = 0; i < length; i++) {
+        int space = (answer[i] == ' ' || answer[i] == '\n' || answer[i] == '\t' || answer[i] == '\r');
+        if (!space && !in_word) {
+            words++;
+        }
+        in_word = !space;
+    }
+    munmap(map, map_length);
+    return words;
+}
+
+// Three-way merge of the rubric file into the shared rubric. The base is rubric_on_disk,
+// the rubric as this run last wrote or read it, so a line that differs from the base in the
+// file was edited from outside the run. Those lines are taken into the shared rubric; if a
+// TA corrected the same line since, the outside edit wins. Caller holds SEM_QUESTIONS and
+// SEM_RUBRIC. Returns the number of lines taken from the file.
+static int merge_rubric_file(shared_data_t *shared_data) {
+    char edited[RUBRIC_SIZE][MAX_LINE_LENGTH];
+    int lines = read_rubric_file(edited);
+    if (lines < RUBRIC_SIZE) {
+        // Missing, or caught half-written: keep what we have
+        if (lines >= 0) {
+            printf("Rubric reload: %s has %d of %d lines, ignored\n", RUBRIC_FILE, lines, RUBRIC_SIZE);
+        }
+        return 0;
+    }
+
+    int taken = 0;
+    for (int i = 0; i < RUBRIC_SIZE; i++) {
+        char *base = shared_data->rubric_on_disk[i];
+        char *current = shared_data->rubric[i];
+        if (strcmp(edited[i], base) == 0 || strcmp(edited[i], current) == 0) {
+            snprintf(base, MAX_LINE_LENGTH, "%s", edited[i]);
+            continue;  // Not edited outside the run, or already the same
+        }
+        int conflict = strcmp(current, base) != 0;
+        printf("Rubric reload: Q%d \"%s\" -> \"%s\"%s\n", i + 1, current, edited[i],
+               conflict ? " (overrides a TA correction)" : "");
+        shared_data->rubric_reload_conflicts += conflict;
+        snprintf(current, MAX_LINE_LENGTH, "%s", edited[i]);
+        snprintf(base, MAX_LINE_LENGTH, "%s", edited[i]);
+        taken++;
+    }
+    if (taken > 0) {
+        shared_data->rubric_version++;
+        shared_data->rubric_reloads++;
+        printf("Rubric reload: published as version %d\n", shared_data->rubric_version);
+    }
+    return taken;
+}
+
+// Function to save rubric back to file
+static void save_rubric(shared_data_t *shared_data, int semid) {
+    sem_wait(semid, SEM_RUBRIC);  // Only one TA modifies rubric file
+
+    // Pick up any outside edit first, so writing the file never discards it
+    merge_rubric_file(shared_data);
+
+    // Write a temporary file and rename it over the rubric, so a reader (or the watcher)
+    // never sees a half-written file
+    char temp_name[64];
+    snprintf(temp_name, sizeof(temp_name), "%s.%d", RUBRIC_FILE, (int)getpid());
+    FILE *file = fopen(temp_name, "w");
+    if (file == NULL) {
+        perror("Failed to open rubric file for writing");
+        sem_signal(semid, SEM_RUBRIC);
+        return;
+    }
+    
+    for (int i = 0; i < RUBRIC_SIZE; i++) {
+        fprintf(file, "%s\n", shared_data->rubric[i]);
+    }
+    if (fclose(file) != 0 || rename(temp_name, RUBRIC_FILE) == -1) {
+        perror("Failed to save rubric file");
+        unlink(temp_name);
+    } else {
+        memcpy(shared_data->rubric_on_disk, shared_data->rubric, sizeof(shared_data->rubric));
+    }
+    
+    sem_signal(semid, SEM_RUBRIC);
+}
+
+// Sharded run: the parent does a course's file work (rubric, exam files) from its directory
+static void enter_shard_dir(int shard) {
+    if (shards[shard].dir_fd >= 0 && fchdir(shards[shard].dir_fd) == -1) {
+        perror("Failed to enter the course directory");
+    }
+}
+
+static void leave_shard_dir(void) {
+    if (home_dir_fd >= 0 && fchdir(home_dir_fd) == -1) {
+        perror("Failed to return to the working directory");
+    }
+}
+
+// inotify descriptor watching the rubric's directory, one watch per course (parent only, -1 if unavailable)
+static int rubric_watch_fd = -1;
+
+#define RUBRIC_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+// Watch for outside edits of the rubric. The directory is watched rather than the file,
+// because editors (and save_rubric) replace the file by renaming, which ends a file watch.
+static void open_rubric_watch(void) {
+    rubric_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (rubric_watch_fd == -1) {
+        perror("inotify_init1 failed (rubric edits will not be picked up)");
+        return;
+    }
+    for (int s = 0; s < num_shards; s++) {
+        const char *dir = shards[s].dir_fd >= 0 ? shards[s].shared_data->shard_dir : ".";
+        shards[s].watch_wd = inotify_add_watch(rubric_watch_fd, dir, RUBRIC_WATCH_EVENTS);
+        if (shards[s].watch_wd == -1) {
+            perror("inotify_add_watch failed (rubric edits will not be picked up)");
+        }
+    }
+}
+
+// Daemon: watch the new batch's directory instead. The inotify descriptor is kept, because
+// closing one waits for an RCU grace period (milliseconds) while moving a watch is cheap.
+static void move_rubric_watch(void) {
+    if (rubric_watch_fd == -1) {
+        open_rubric_watch();
+        return;
+    }
+    inotify_rm_watch(rubric_watch_fd, shards[0].watch_wd);
+    shards[0].watch_wd = inotify_add_watch(rubric_watch_fd, ".", RUBRIC_WATCH_EVENTS);
+    if (shards[0].watch_wd == -1) {
+        perror("inotify_add_watch failed (rubric edits will not be picked up)");
+    }
+}
+
+static void close_rubric_watch(void) {
+    if (rubric_watch_fd != -1) {
+        close(rubric_watch_fd);
+        rubric_watch_fd = -1;
+    }
+}
+
+// Called from the parent's polling loops: if a rubric file changed, merge it and publish
+// the result as a new rubric version of its course. TAs keep marking; the locks are only
+// held for the merge. The parent never waits for a TA that is correcting the rubric or for
+// a free history slot: the edit stays pending and is retried on the next call, so dead TAs
+// are still recovered in the meantime.
+static void check_rubric_edits(void) {
+    if (rubric_watch_fd == -1) {
+        return;
+    }
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int touched[MAX_SHARDS] = {0}, any = 0;
+    for (int s = 0; s < num_shards; s++) {
+        touched[s] = shards[s].rubric_pending;
+        any |= touched[s];
+    }
+    ssize_t length;
+    while ((length = read(rubric_watch_fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            for (int s = 0; s < num_shards && event->len > 0; s++) {
+                if (event->wd == shards[s].watch_wd && strcmp(event->name, RUBRIC_FILE) == 0) {
+                    touched[s] = 1;
+                    any = 1;
+                }
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    if (!any) {
+        return;  // Also the case for the renames of save_rubric, merged when they were written
+    }
+
+    for (int s = 0; s < num_shards; s++) {
+        if (!touched[s]) {
+            continue;
+        }
+        shared_data_t *shared_data = shards[s].shared_data;
+        int semid = shards[s].semid;
+        enter_shard_dir(s);
+        if (sem_try_wait(semid, SEM_QUESTIONS) == -1) {  // Same order as check_rubric: the rubric, then its file
+            shards[s].rubric_pending = 1;  // A TA holds it, possibly waiting in publish_rubric
+            continue;
+        }
+        sem_wait(semid, SEM_RUBRIC);
+        if (merge_rubric_file(shared_data) > 0 || shards[s].rubric_pending) {
+            shards[s].rubric_pending = publish_rubric(shared_data, 0) == -1;
+        }
+        sem_signal(semid, SEM_RUBRIC);
+        sem_signal(semid, SEM_QUESTIONS);
+    }
+    leave_shard_dir();
+}
+
+// Function to check and potentially correct rubric
+static void check_rubric(shared_data_t *shared_data, int ta_id, int semid) {
+    set_ta_state(TA_CHECKING_RUBRIC);
+    printf("TA %d: Checking rubric...\n", ta_id);
+    
+    for (int i = 0; i < RUBRIC_SIZE && !stop_requested(shared_data); i++) {
+        // Random delay between 0.5-1.0 seconds
+        double delay_seconds = 0.5 + (rand() % 501) / 1000.0;  // 0.5 to 1.0 seconds
+        pause_ms((int)(delay_seconds * 1000));
+
+        // Thinking time in seconds, for the output
+        double think_time = delay_seconds;
+        
+        // Correct the line 30% of the time
+        int should_correct = (rand() % 100 < 30);
+        
+        if (should_correct) {
+            sem_wait(semid, SEM_QUESTIONS);  // Lock rubric for modification
+            
+            char *comma_pos = strchr(shared_data->rubric[i], ',');
+            if (comma_pos != NULL && *(comma_pos + 2) != '\0') {
+                char current_char = *(comma_pos + 2);
+                
+                char new_char;
+                if (current_char >= 'A' && current_char <= 'Z') {
+                    new_char = 'A' + ((current_char - 'A' + 1) % 26);
+                } else {
+                    new_char = current_char + 1;
+                }
+                *(comma_pos + 2) = new_char;
+                shared_data->rubric_version++;
+                
+                printf("TA %d: thinks for %.1fs on Q%d → Corrects: %c→%c\n", 
+                       ta_id, think_time, i+1, current_char, new_char);
+
+                save_rubric(shared_data, semid);
+                publish_rubric(shared_data, 1);  // Exams loaded from now on pin the new version
+            }
+            
+            sem_signal(semid, SEM_QUESTIONS);  // Release rubric lock
+        } else {
+            printf("TA %d: thinks for %.1fs on Q%d → No Correction Needed\n", 
+                   ta_id, think_time, i+1);
+        }
+    }
+}
+
+// Speed-aware assignment tuning
+#define MARKING_EWMA_ALPHA   0.3    // Weight of the newest question in a TA's speed estimate
+#define TAIL_QUESTIONS       2      // The last this-many free questions of an exam are the "tail"
+#define TAIL_SPEED_MARGIN    1.25   // Another TA counts as faster if it is 25% quicker
+#define MAX_TAIL_DEFERRALS   3      // Never defer more often than this in a row (no livelock)
+#define SPECULATE_FACTOR     2.0    // A question is a straggler after this many times its owner's EWMA
+#define SPECULATE_POLL_MS    200    // How often an idle marker looks for stragglers
+
+// Speed-aware tail steering (caller holds SEM_SHARED): should this TA leave one of the
+// last free questions of an exam to faster TAs that are not busy marking right now?
+static int should_defer_tail(shared_data_t *shared_data, int free_questions) {
+    if (!shared_data->speed_aware || my_status == NULL || free_questions > TAIL_QUESTIONS) {
+        return 0;
+    }
+    int mine = my_status->marking_ewma_ms;
+    if (mine == 0 || my_status->tail_deferrals >= MAX_TAIL_DEFERRALS) {
+        return 0;
+    }
+
+    int faster_available = 0;
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        const ta_status_t *ta = &shared_data->tas[i];
+        if (ta == my_status || ta->state == TA_EXITED || ta->state == TA_MARKING ||
+            ta->role == ROLE_LOADER || ta->role == ROLE_REVIEWER) {
+            continue;
+        }
+        if (ta->marking_ewma_ms > 0 && ta->marking_ewma_ms * TAIL_SPEED_MARGIN < mine) {
+            faster_available++;
+        }
+    }
+    if (faster_available < free_questions) {
+        return 0;
+    }
+
+    my_status->tail_deferrals++;
+    __atomic_add_fetch(&shared_data->tail_deferrals, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Mark one claimed question (the marking itself needs no lock)
+// Marks one question and returns the mark given (simulated, 0 to MAX_MARK)
+static int mark_one_question(shared_data_t *shared_data, int ta_id, const exam_info_t *exam, int question) {
+    if (my_status != NULL) {
+        my_status->question = question;
+        my_status->student_id = exam->student_id;
+    }
+    set_ta_state(TA_MARKING);
+
+    long words = read_answer_section(exam->file, exam->answer_offset[question], exam->answer_length[question]);
+    char rubric_line[MAX_LINE_LENGTH] = "?";
+    read_pinned_rubric(shared_data, exam->rubric_version, question, rubric_line);
+    printf("TA %d: Marking question %d for student %d (%ld-word answer, rubric v%d \"%s\")\n", 
+           ta_id, question + 1, exam->student_id, words, exam->rubric_version, rubric_line);
+    last_words = words;
+    
+    long long started = monotonic_ms();
+    pause_ms(1000 * (1 + rand() % 2));  // 1 or 2 seconds for marking
+    int mark = rand() % (MAX_MARK + 1);
+    snprintf(last_feedback, sizeof(last_feedback), "marked against \"%s\"", rubric_line);
+    
+    printf("TA %d: Finished marking question %d for student %d (%d/%d)\n", 
+           ta_id, question + 1, exam->student_id, mark, MAX_MARK);
+    if (my_status != NULL) {
+        my_status->question = -1;
+        my_status->questions_marked++;
+
+        // Recent marking speed: EWMA so a TA that slows down is noticed within a few questions
+        int sample = (int)(monotonic_ms() - started);
+        int ewma = my_status->marking_ewma_ms;
+        my_status->marking_ewma_ms = ewma == 0 ? sample : (int)(MARKING_EWMA_ALPHA * sample + (1 - MARKING_EWMA_ALPHA) * ewma);
+    }
+    set_ta_state(TA_IDLE);
+    return mark;
+}
+
+// Stamp an exam's first question claim (only the first claimer's CAS succeeds)
+static void record_question_claimed(shared_data_t *shared_data, int exam_index) {
+    long long unset = -1;
+    long long now = run_time_ms(shared_data);
+    __atomic_compare_exchange_n(&shared_data->exam_records[exam_index].first_claim_ms, &unset, now,
+                                0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// Count a finished question; whoever finishes the last one stamps the exam complete.
+// Atomic, so neither marking mode needs a lock for it.
+static void record_question_done(shared_data_t *shared_data, int exam_index) {
+    exam_record_t *record = &shared_data->exam_records[exam_index];
+    if (__atomic_add_fetch(&record->questions_done, 1, __ATOMIC_ACQ_REL) == RUBRIC_SIZE) {
+        record->completed_ms = run_time_ms(shared_data);
+    }
+}
+
+// Function to mark questions with synchronization 
+// Take one piece of a dead TA's work off the orphan list (caller holds SEM_SHARED).
+// whole_exam selects loader work (question -1) or marking work. Returns the exam
+// index and stores the question, or returns -1 if there is none.
+static int pop_orphan(shared_data_t *shared_data, int whole_exam, int *question) {
+    for (int i = 0; i < shared_data->num_orphaned; i++) {
+        if ((shared_data->orphaned_question[i] < 0) != whole_exam) {
+            continue;
+        }
+        int exam_index = shared_data->orphaned_exam[i];
+        *question = shared_data->orphaned_question[i];
+        int last = --shared_data->num_orphaned;
+        shared_data->orphaned_exam[i] = shared_data->orphaned_exam[last];
+        shared_data->orphaned_question[i] = shared_data->orphaned_question[last];
+        return exam_index;
+    }
+    return -1;
+}
+
+// Re-mark a question whose TA died after the exam had already moved on. Returns 1 if it did.
+static int mark_orphaned_question(shared_data_t *shared_data, int ta_id, int semid) {
+    if (shared_data->num_orphaned == 0) {
+        return 0;  // Unlocked peek: the common case costs nothing
+    }
+    shared_lock(shared_data, semid);
+    int question;
+    int exam_index = pop_orphan(shared_data, 0, &question);
+    if (exam_index >= 0) {
+        my_status->claim_exam = exam_index;
+        my_status->claim_question = question;
+    }
+    shared_unlock(shared_data, semid);
+    if (exam_index < 0) {
+        return 0;
+    }
+
+    exam_info_t exam;
+    if (read_exam(exam_index, &exam) == 0) {
+        pin_exam_rubric(shared_data, &exam);  // Keeps the version the exam was first pinned to
+        printf("TA %d: Re-marking question %d for student %d (its TA died)\n",
+               ta_id, question + 1, exam.student_id);
+        int mark = mark_one_question(shared_data, ta_id, &exam, question);
+        record_mark(shared_data, &exam, question, mark);
+        record_question_done(shared_data, exam_index);
+    }
+    my_status->claim_exam = -1;
+    return 1;
+}
+
+static void mark_questions(shared_data_t *shared_data, int ta_id, int semid) {
+    
+    // CAPTURE student ID at start
+    shared_lock(shared_data, semid);
+    int captured_student_id = shared_data->current_exam.student_id;  // Save it!
+    shared_unlock(shared_data, semid);
+
+    printf("TA %d: Starting to mark exam for student %d\n", ta_id, captured_student_id);
+    
+    int marked_any = 0;
+    
+    for (int attempt = 0; attempt < RUBRIC_SIZE && !shared_data->shutdown_requested; attempt++) {  // Limit attempts to prevent infinite loop
+        shared_lock(shared_data, semid);
+        
+        // Find an unmarked question
+        int question_to_mark = -1;
+        exam_info_t exam;
+        int free_questions = 0;
+        for (int i = 0; i < RUBRIC_SIZE; i++) {
+            free_questions += (shared_data->questions_marked[i] == 0);
+        }
+        if (shared_data->current_exam.student_id == 9999) {
+            // The terminator was loaded while this TA was reviewing the rubric: nothing to mark
+            shared_unlock(shared_data, semid);
+            break;
+        }
+        if (free_questions > 0 && should_defer_tail(shared_data, free_questions)) {
+            shared_unlock(shared_data, semid);
+            printf("TA %d: Leaving the last %d question(s) of student %d to faster TAs\n",
+                   ta_id, free_questions, shared_data->current_exam.student_id);
+            break;
+        }
+        for (int i = 0; i < RUBRIC_SIZE; i++) {
+            if (shared_data->questions_marked[i] == 0) {
+                question_to_mark = i;
+                shared_data->questions_marked[i] = 1;  // Mark as in progress
+                marked_any = 1;
+
+                // The exam may move on once we unlock, so take a copy now
+                exam = shared_data->current_exam;
+                captured_student_id = exam.student_id;
+                my_status->tail_deferrals = 0;
+                my_status->claim_exam = exam.exam_index;
+                my_status->claim_question = i;
+                break;
+            }
+        }
+        
+        shared_unlock(shared_data, semid);
+        
+        if (question_to_mark == -1) {
+            // No more questions to mark
+            if (!marked_any) {
+                printf("TA %d: No questions available to mark for student %d\n", 
+                       ta_id, captured_student_id);
+            }
+            break;
+        }
+        
+        // Mark the question
+        record_question_claimed(shared_data, exam.exam_index);
+        int mark = mark_one_question(shared_data, ta_id, &exam, question_to_mark);
+        record_mark(shared_data, &exam, question_to_mark, mark);
+        record_question_done(shared_data, exam.exam_index);
+        my_status->claim_exam = -1;
+        
+        pause_ms(100);  // Small delay
+    }
+    
+    if (marked_any) {
+        printf("TA %d: Completed marking questions for student %d\n", ta_id, captured_student_id);
+    }
+}
+
+// Questions waiting for a TA: unclaimed ones of the current exam plus every later exam
+static int questions_waiting(const shared_data_t *shared_data) {
+    int backlog = 0;
+    for (int i = 0; i < RUBRIC_SIZE; i++) {
+        if (shared_data->questions_marked[i] == 0) {
+            backlog++;
+        }
+    }
+    int later_exams = shared_data->total_exams - shared_data->current_exam_index - 1;
+    if (later_exams > 0) {
+        backlog += later_exams * RUBRIC_SIZE;
+    }
+    return backlog;
+}
+
+// ---------------------------------------------------------------------------
+// Sharded runs: every course has its own segment and semaphores, and one TA pool
+// serves them all. A TA works on one course at a time and only reconsiders at the
+// top of its loop, where it holds no claims and no locks, so courses never contend.
+// ---------------------------------------------------------------------------
+
+// Questions of a course still waiting for a TA, including a dead TA's. Read without the
+// course's lock: it only steers TAs, like the unlocked peek at the orphan list.
+static int shard_backlog(const shared_data_t *shared_data) {
+    if (stop_requested(shared_data)) {
+        return 0;
+    }
+    return questions_waiting(shared_data) + shared_data->num_orphaned;
+}
+
+// TAs working on a course (a dead TA's count is only dropped once the parent recovers it)
+static int shard_tas(const shared_data_t *shared_data) {
+    int tas = __atomic_load_n(&shared_data->shard_tas, __ATOMIC_RELAXED);
+    return tas > 0 ? tas : 0;
+}
+
+// Course with the most backlog per TA if this TA joined it, -1 once no course has any
+static int pick_shard(void) {
+    int best = -1, best_backlog = 0, best_tas = 0;
+    for (int s = 0; s < num_shards; s++) {
+        int backlog = shard_backlog(shards[s].shared_data);
+        int tas = shard_tas(shards[s].shared_data);
+        // backlog / (tas + 1) > best_backlog / (best_tas + 1), without dividing
+        if (backlog > 0 && (best < 0 || (long long)backlog * (best_tas + 1) > (long long)best_backlog * (tas + 1))) {
+            best = s;
+            best_backlog = backlog;
+            best_tas = tas;
+        }
+    }
+    return best;
+}
+
+// Should this TA leave its course? Only if another course, with this TA added, would still
+// have more backlog per TA than this one has without it. A move can then never be undone
+// by the next TA's decision, so TAs do not bounce between courses.
+static int shard_should_move(shared_data_t *shared_data) {
+    int backlog = shard_backlog(shared_data);
+    int others = shard_tas(shared_data) - 1;  // TAs that stay if this one leaves
+    for (int s = 0; s < num_shards; s++) {
+        if (s == shared_data->shard_index) {
+            continue;
+        }
+        int their_backlog = shard_backlog(shards[s].shared_data);
+        int their_tas = shard_tas(shards[s].shared_data) + 1;
+        if (their_backlog > 0 && (backlog == 0 ||
+            (long long)their_backlog * others > (long long)backlog * their_tas)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Switch this TA to a course: its files, its status slot and its TA count
+static shared_data_t *enter_shard(int shard, int ta_id, int previous) {
+    shared_data_t *shared_data = shards[shard].shared_data;
+    if (shards[shard].dir_fd >= 0 && fchdir(shards[shard].dir_fd) == -1) {
+        perror("Failed to enter the course directory");
+    }
+    __atomic_store_n(&shards[0].shared_data->tas[ta_id - 1].shard, shard, __ATOMIC_SEQ_CST);
+    my_status = &shared_data->tas[ta_id - 1];
+    my_status->state_since_ms = monotonic_ms();  // Time spent in other courses is not charged here
+    my_status->state = TA_IDLE;
+    my_status->in_shard = 1;
+    __atomic_add_fetch(&shared_data->shard_tas, 1, __ATOMIC_SEQ_CST);
+    if (previous >= 0) {
+        __atomic_add_fetch(&shared_data->shard_arrivals, 1, __ATOMIC_RELAXED);
+    }
+    printf("TA %d: Working on course %d (%s), %d question(s) waiting\n", ta_id, shard + 1,
+           shared_data->shard_dir, shard_backlog(shared_data));
+    return shared_data;
+}
+
+static void leave_shard(shared_data_t *shared_data) {
+    set_ta_state(TA_EXITED);  // Gone as far as this course's monitor is concerned
+    if (__atomic_exchange_n(&my_status->in_shard, 0, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&shared_data->shard_tas, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+// Classic TA loop: check the rubric, mark questions of the current exam, load the next
+// exam once every question is claimed, until the terminator or a shutdown
+static void ta_process(shared_data_t *shared_data, int ta_id, int semid) {
+    while (1) {       
+        set_ta_state(TA_IDLE);
+
+        // The autoscaling supervisor retires TAs here, where they hold no claims
+        if (my_status->retire_requested) {
+            printf("TA %d: Retiring - pool is larger than the workload needs\n", ta_id);
+            break;
+        }
+
+        if (shared_data->shutdown_requested) {
+            printf("TA %d: Stopping - shutdown requested\n", ta_id);
+            break;
+        }
+
+        // Sharded run: another course needs this TA more
+        if (shared_data->num_shards > 1 && shard_should_move(shared_data)) {
+            break;
+        }
+
+        // Work left behind by a dead TA comes first, even after the last exam was reached
+        if (mark_orphaned_question(shared_data, ta_id, semid)) {
+            continue;
+        }
+
+        // Brief check for termination
+        shared_lock(shared_data, semid);
+        if (shared_data->exams_finished) {
+            shared_unlock(shared_data, semid);
+            printf("TA %d: Exiting - all exams completed\n", ta_id);
+            break;
+        }
+        shared_unlock(shared_data, semid);
+
+        
+        // Check if we need to load next exam if all questions have been marked
+        // Ensures TAs arent loading next exam txt file at the same time and corrupting it
+        shared_lock(shared_data, semid);
+
+        // Before even performing any activities on the exam, check if we need have reached
+        if (shared_data->current_exam.student_id == 9999) {
+            shared_data->exams_finished = 1;  // Exam marking as concluded
+            printf("TA %d: Found termination exam (9999)\n", ta_id);
+            shared_unlock(shared_data, semid);
+            break;
+        }
+
+        // Re-check termination inside critical section if break fails?
+        if (shared_data->exams_finished) {
+            shared_unlock(shared_data, semid);
+            break;
+        }
+
+       // Check if current exam still needs questions to be marked
+        int all_questions_marked = 1;
+        for (int i = 0; i < RUBRIC_SIZE; i++) {
+            if (shared_data->questions_marked[i] == 0) {
+                all_questions_marked = 0;
+                break;
+            }
+        }
+
+        // If all questions answered, check if we move to the next exam or break since we are finished
+        if (all_questions_marked) {
+            // Move to next exam 
+            set_ta_state(TA_LOADING_EXAM);
+            shared_data->current_exam_index++;
+            if (shared_data->current_exam_index < shared_data->total_exams) {
+                load_exam_file(shared_data, scheduled_exam(shared_data, shared_data->current_exam_index));
+                shared_unlock(shared_data, semid);
+                continue;
+            } else {
+                shared_data->exams_finished = 1;
+                printf("TA %d: No more exams to mark\n", ta_id);
+                shared_unlock(shared_data, semid);
+                break;
+            }
+        }
+        shared_unlock(shared_data, semid); // release lock for actual work
+
+        // Check conditions AFTER releasing lock
+        if (shared_data->exams_finished || shared_data->current_exam.student_id == 9999) {
+            break;
+        }
+
+
+        // Check rubric
+        check_rubric(shared_data, ta_id, semid);
+            
+        // Mark questions
+        mark_questions(shared_data, ta_id, semid);
+        
+        // Small delay to prevent tight loop
+        pause_ms(100);  // 0.1 seconds
+    }   
+}        
+
+
+
+
+// Daemon mode: a TA outlives its batch. It sleeps on SEM_BATCH, which gets one token per TA
+// for every batch started, marks the batch from its directory like a classic TA, and goes back
+// to sleep. The daemon knows the batch is complete once every token has been worked off.
+static void daemon_ta_process(shared_data_t *shared_data, int ta_id, int semid) {
+    while (1) {
+        set_ta_state(TA_IDLE);
+        sem_wait(semid, SEM_BATCH);
+        if (shared_data->shutdown_requested) {
+            printf("TA %d: Stopping - daemon shutting down\n", ta_id);
+            break;
+        }
+        my_status->in_batch = 1;
+        if (chdir(shared_data->batch_dir) == -1) {
+            perror("Failed to enter the batch directory");
+        } else {
+            ta_process(shared_data, ta_id, semid);
+        }
+        fflush(stdout);  // A TA never exits between batches, so its log would sit in the buffer
+        if (__atomic_exchange_n(&my_status->in_batch, 0, __ATOMIC_SEQ_CST)) {
+            __atomic_sub_fetch(&shared_data->batch_busy_tas, 1, __ATOMIC_SEQ_CST);
+        }
+        if (shared_data->shutdown_requested) {
+            break;
+        }
+    }
+}
+
+// Sharded run: work on the course the parent placed this TA in, then on whichever course
+// has the most backlog per TA, until no course has questions left
+static void sharded_ta_process(int ta_id) {
+    ta_status_t *home = &shards[0].shared_data->tas[ta_id - 1];
+    int shard = home->shard, previous = -1;
+    while (!shards[0].shared_data->shutdown_requested) {
+        if (shard < 0 || shard_backlog(shards[shard].shared_data) == 0) {
+            shard = pick_shard();
+        }
+        if (shard < 0) {
+            printf("TA %d: Exiting - no course has questions left\n", ta_id);
+            break;
+        }
+        shared_data_t *shared_data = enter_shard(shard, ta_id, previous);
+        ta_process(shared_data, ta_id, shards[shard].semid);
+        leave_shard(shared_data);
+        previous = shard;
+        shard = -1;
+    }
+    my_status = home;
+}
+
+// ---------------------------------------------------------------------------
+// Pipeline mode: loaders fill a bounded exam queue, markers drain it question by
+// question, and reviewers check the rubric in parallel so marking never waits on
+// a rubric pass. SEM_SLOTS_FREE counts free queue slots and SEM_WORK counts
+// unclaimed questions (plus end-of-stream tokens), as in a bounded buffer.
+// ---------------------------------------------------------------------------
+
+// Role of the TA with the given 0-based index: loaders first, then reviewers, then markers
+static ta_role_t pipeline_role(const run_options_t *opts, int ta_index) {
+    if (!opts->pipeline) {
+        return ROLE_ALL;
+    }
+    if (ta_index < opts->num_loaders) {
+        return ROLE_LOADER;
+    }
+    if (ta_index < opts->num_loaders + opts->num_reviewers) {
+        return ROLE_REVIEWER;
+    }
+    return ROLE_MARKER;
+}
+
+// Auto-balance: most processes mark, about a quarter review, loading is cheap
+static void pipeline_auto_roles(run_options_t *opts) {
+    opts->num_loaders = 1 + opts->num_tas / 16;
+    int rest = opts->num_tas - opts->num_loaders;
+    opts->num_reviewers = rest >= 2 ? (rest / 4 > 0 ? rest / 4 : 1) : 0;
+    opts->num_markers = rest - opts->num_reviewers;
+}
+
+// Caller holds SEM_SHARED: the batch is over once loading stopped and the queue drained
+static void pipeline_check_finished(shared_data_t *shared_data) {
+    if (shared_data->loading_done && shared_data->active_loaders == 0 &&
+        shared_data->queue_tail == shared_data->queue_head) {
+        shared_data->exams_finished = 1;
+    }
+}
+
+static void loader_process(shared_data_t *shared_data, int ta_id, int semid) {
+    while (!shared_data->shutdown_requested) {
+        set_ta_state(TA_IDLE);
+
+        // Exams a dead loader had taken go first
+        int exam_index = -1, unused;
+        if (shared_data->num_orphaned > 0) {
+            shared_lock(shared_data, semid);
+            exam_index = pop_orphan(shared_data, 1, &unused);
+            shared_unlock(shared_data, semid);
+        }
+
+        // Dequeue the next exam in priority order: one atomic increment, no lock
+        if (exam_index < 0 && !shared_data->loading_done) {
+            int position = __atomic_fetch_add(&shared_data->current_exam_index, 1, __ATOMIC_RELAXED);
+            exam_index = scheduled_exam(shared_data, position);
+        }
+        my_status->claim_exam = exam_index;
+        my_status->claim_question = -1;
+        if (exam_index < 0) {
+            shared_lock(shared_data, semid);
+            shared_data->loading_done = 1;
+            shared_unlock(shared_data, semid);
+            break;
+        }
+
+        // File I/O happens outside every lock
+        set_ta_state(TA_LOADING_EXAM);
+        exam_info_t exam;
+        if (read_exam(exam_index, &exam) == -1) {
+            my_status->claim_exam = -1;
+            continue;
+        }
+        pin_exam_rubric(shared_data, &exam);
+        if (exam.student_id == 9999) {
+            my_status->claim_exam = -1;
+            shared_lock(shared_data, semid);
+            shared_data->loading_done = 1;
+            shared_unlock(shared_data, semid);
+            printf("TA %d: Found termination exam (9999)\n", ta_id);
+            break;
+        }
+
+        // Wait for a free queue slot; a loader that would block reviews the rubric instead
+        if (sem_try_wait(semid, SEM_SLOTS_FREE) == -1) {
+            check_rubric(shared_data, ta_id, semid);
+            set_ta_state(TA_IDLE);
+            sem_wait(semid, SEM_SLOTS_FREE);
+        }
+        if (shared_data->shutdown_requested) {
+            break;  // Woken by the shutdown broadcast, not by a free slot
+        }
+        my_status->holds_slot = 1;
+
+        shared_lock(shared_data, semid);
+        exam_slot_t *slot = &shared_data->exam_queue[shared_data->queue_head % EXAM_QUEUE_SIZE];
+        slot->exam = exam;
+        for (int i = 0; i < RUBRIC_SIZE; i++) {
+            slot->question_state[i] = QUESTION_FREE;
+        }
+        slot->questions_done = 0;
+        shared_data->exam_records[exam.exam_index].loaded_ms = run_time_ms(shared_data);
+        shared_data->queue_head++;
+        my_status->claim_exam = -1;
+        my_status->holds_slot = 0;
+        shared_unlock(shared_data, semid);
+
+        sem_signal_n(semid, SEM_WORK, RUBRIC_SIZE);
+        printf("\nTA %d: Queued exam: %s (Student ID: %d)\n\n", ta_id, exam.file, exam.student_id);
+    }
+
+    // The last loader out wakes every marker so they notice the end of the stream
+    shared_lock(shared_data, semid);
+    int remaining = --shared_data->active_loaders;
+    if (remaining == 0) {
+        pipeline_check_finished(shared_data);
+    }
+    shared_unlock(shared_data, semid);
+    if (remaining == 0) {
+        sem_signal_n(semid, SEM_WORK, shared_data->num_markers);
+    }
+    printf("TA %d: Loader exiting - no more exams to load\n", ta_id);
+}
+
+// A marked pipeline question is done unless a speculative copy finished first.
+// Retires fully marked exams from the tail so loaders can reuse their slots.
+// position is the exam's queue position (not the ring index): if the exam was already
+// retired, its slot may hold a newer exam by now. Returns 1 if this result counted.
+static int finish_pipeline_question(shared_data_t *shared_data, int semid, int position, int question) {
+    shared_lock(shared_data, semid);
+    exam_slot_t *slot = &shared_data->exam_queue[position % EXAM_QUEUE_SIZE];
+    int counted = position >= shared_data->queue_tail && slot->question_state[question] != QUESTION_DONE;
+    if (counted) {
+        slot->question_state[question] = QUESTION_DONE;
+        slot->questions_done++;
+        record_question_done(shared_data, slot->exam.exam_index);
+    }
+    int retired = 0;
+    while (shared_data->queue_tail < shared_data->queue_head &&
+           shared_data->exam_queue[shared_data->queue_tail % EXAM_QUEUE_SIZE].questions_done == RUBRIC_SIZE) {
+        shared_data->queue_tail++;
+        retired++;
+    }
+    int was_finished = shared_data->exams_finished;
+    pipeline_check_finished(shared_data);
+    int just_finished = !was_finished && shared_data->exams_finished;
+    shared_unlock(shared_data, semid);
+    sem_signal_n(semid, SEM_SLOTS_FREE, retired);
+    if (just_finished) {
+        sem_signal_n(semid, SEM_WORK, shared_data->num_markers);  // Wake every marker to exit
+    }
+    return counted;
+}
+
+// Speculative re-marking: an idle marker re-marks a question whose owner has held it for
+// well over its usual time, and whichever copy finishes first counts. Returns 1 if it ran.
+static int try_speculate(shared_data_t *shared_data, int ta_id, int semid) {
+    int mine = my_status->marking_ewma_ms;
+    if (mine == 0) {
+        return 0;
+    }
+
+    shared_lock(shared_data, semid);
+    long long now = monotonic_ms();
+    int position = -1, question = -1, owner = 0;
+    exam_info_t exam;
+    for (int n = shared_data->queue_tail; n < shared_data->queue_head && question < 0; n++) {
+        exam_slot_t *slot = &shared_data->exam_queue[n % EXAM_QUEUE_SIZE];
+        for (int i = 0; i < RUBRIC_SIZE; i++) {
+            if (slot->question_state[i] != QUESTION_CLAIMED || slot->speculator[i] != 0 ||
+                slot->claim_owner[i] == ta_id) {
+                continue;
+            }
+            int owner_ewma = shared_data->tas[slot->claim_owner[i] - 1].marking_ewma_ms;
+            if (owner_ewma > mine && now - slot->claim_ms[i] > SPECULATE_FACTOR * owner_ewma) {
+                slot->speculator[i] = ta_id;
+                position = n;
+                question = i;
+                owner = slot->claim_owner[i];
+                exam = slot->exam;
+                break;
+            }
+        }
+    }
+    shared_unlock(shared_data, semid);
+    if (question < 0) {
+        return 0;
+    }
+
+    __atomic_add_fetch(&shared_data->speculative_started, 1, __ATOMIC_RELAXED);
+    printf("TA %d: Speculatively re-marking question %d for student %d (TA %d is slow)\n",
+           ta_id, question + 1, exam.student_id, owner);
+    int mark = mark_one_question(shared_data, ta_id, &exam, question);
+    if (finish_pipeline_question(shared_data, semid, position, question)) {
+        record_mark(shared_data, &exam, question, mark);
+        __atomic_add_fetch(&shared_data->speculative_won, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&shared_data->speculative_wasted, 1, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+static void marker_process(shared_data_t *shared_data, int ta_id, int semid) {
+    while (!stop_requested(shared_data)) {
+        set_ta_state(TA_IDLE);
+
+        // One token per unclaimed question; with speculation on, idle markers wake up
+        // periodically to look for stragglers instead of blocking indefinitely
+        if (shared_data->speculate) {
+            if (sem_wait_timeout(semid, SEM_WORK, SPECULATE_POLL_MS) == -1) {
+                try_speculate(shared_data, ta_id, semid);
+                continue;
+            }
+        } else {
+            sem_wait(semid, SEM_WORK);
+        }
+        if (shared_data->shutdown_requested) {
+            break;
+        }
+
+        // Claim the oldest free question in the queue
+        shared_lock(shared_data, semid);
+        int position = -1, question = -1, deferred = 0;
+        exam_info_t exam;
+        for (int n = shared_data->queue_tail; n < shared_data->queue_head && question < 0; n++) {
+            exam_slot_t *slot = &shared_data->exam_queue[n % EXAM_QUEUE_SIZE];
+            int free_questions = 0;
+            for (int i = 0; i < RUBRIC_SIZE; i++) {
+                free_questions += (slot->question_state[i] == QUESTION_FREE);
+            }
+            if (free_questions == 0) {
+                continue;
+            }
+            if (should_defer_tail(shared_data, free_questions)) {
+                deferred = 1;
+                break;
+            }
+            for (int i = 0; i < RUBRIC_SIZE; i++) {
+                if (slot->question_state[i] == QUESTION_FREE) {
+                    slot->question_state[i] = QUESTION_CLAIMED;
+                    slot->claim_owner[i] = ta_id;
+                    slot->claim_ms[i] = monotonic_ms();
+                    slot->speculator[i] = 0;
+                    position = n;
+                    question = i;
+                    exam = slot->exam;
+                    my_status->tail_deferrals = 0;
+                    break;
+                }
+            }
+        }
+        shared_unlock(shared_data, semid);
+
+        if (deferred) {
+            // Hand the token back for a faster marker and step aside briefly
+            sem_signal(semid, SEM_WORK);
+            pause_ms(50);
+            continue;
+        }
+        if (question < 0) {
+            // A token with nothing behind it: end-of-stream, the final wake-up, or the spare
+            // token the parent adds when it recovers a dead marker. Markers stay until the
+            // batch is finished, because a dead marker's claims can come back at any time.
+            continue;
+        }
+
+        record_question_claimed(shared_data, exam.exam_index);
+        int mark = mark_one_question(shared_data, ta_id, &exam, question);
+        if (finish_pipeline_question(shared_data, semid, position, question)) {
+            record_mark(shared_data, &exam, question, mark);  // Only the copy that counted is graded
+        } else {
+            __atomic_add_fetch(&shared_data->speculative_wasted, 1, __ATOMIC_RELAXED);
+        }
+    }
+    printf("TA %d: Marker exiting - all questions marked\n", ta_id);
+}
+
+static void reviewer_process(shared_data_t *shared_data, int ta_id, int semid) {
+    while (!stop_requested(shared_data)) {
+        check_rubric(shared_data, ta_id, semid);
+        set_ta_state(TA_IDLE);
+        pause_ms(100);  // 0.1 seconds between passes
+    }
+    printf("TA %d: Reviewer exiting - all exams completed\n", ta_id);
+}
+
+// Team lock: like shared_lock, but the team's own ticket lock (counted separately)
+static void team_lock(team_t *team) {
+    chaos_point();
+    unsigned int ticket = my_status != NULL
+        ? ticket_lock_take(&team->lock, my_status->pid, &my_status->team_ticket, &my_status->has_team_ticket)
+        : ticket_lock_take(&team->lock, TICKET_ANONYMOUS, NULL, NULL);
+    ticket_lock_wait(&team->lock, ticket);
+    if (my_status != NULL) {
+        my_status->team_lock_acquisitions++;
+    }
+    chaos_point();
+}
+
+static void team_unlock(team_t *team) {
+    chaos_point();
+    ticket_lock_release(&team->lock);
+    if (my_status != NULL) {
+        my_status->has_team_ticket = 0;
+    }
+}
+
+// Caller holds the team lock. A team is done once the dispatcher is empty and its own
+// queue has drained; the last team to finish ends the batch.
+static void team_check_drained(shared_data_t *shared_data, team_t *team, int semid) {
+    if (team->drained || team->refiller != 0 || team->queue_tail != team->queue_head ||
+        !shared_data->dispatch_done || shared_data->num_orphaned > 0) {
+        return;
+    }
+    team->drained = 1;
+    shared_lock(shared_data, semid);  // Lock order is always team, then global
+    if (++shared_data->teams_drained == shared_data->num_teams) {
+        shared_data->exams_finished = 1;
+    }
+    shared_unlock(shared_data, semid);
+}
+
+// The global dispatcher: hand a team up to count exams (a dead TA's first) in one
+// acquisition of the global lock. The batch is recorded in the team until it is queued,
+// so the parent can give it back if the refiller dies. Returns how many exams it took.
+static int dispatch_batch(shared_data_t *shared_data, team_t *team, int semid, int count) {
+    int taken = 0, unused;
+    shared_lock(shared_data, semid);
+    while (taken < count) {
+        int exam_index = pop_orphan(shared_data, 1, &unused);
+        if (exam_index < 0) {
+            break;
+        }
+        team->batch_exams[taken++] = exam_index;
+    }
+    while (taken < count && !shared_data->dispatch_done) {
+        int exam_index = scheduled_exam(shared_data, shared_data->current_exam_index);
+        if (exam_index < 0) {
+            shared_data->dispatch_done = 1;
+            break;
+        }
+        shared_data->current_exam_index++;
+        team->batch_exams[taken++] = exam_index;
+    }
+    team->batch_count = taken;
+    shared_unlock(shared_data, semid);
+    return taken;
+}
+
+// Refill the team queue: one dispatcher call per batch, file I/O outside every lock
+static void team_refill(shared_data_t *shared_data, team_t *team, int ta_id, int semid, int free_slots) {
+    set_ta_state(TA_LOADING_EXAM);
+    int count = dispatch_batch(shared_data, team, semid, free_slots);
+
+    exam_info_t exams[TEAM_QUEUE_SIZE];
+    int loaded = 0;
+    for (int i = 0; i < count; i++) {
+        if (read_exam(team->batch_exams[i], &exams[loaded]) == -1) {
+            continue;
+        }
+        pin_exam_rubric(shared_data, &exams[loaded]);
+        if (exams[loaded].student_id == 9999) {
+            // The terminator is scheduled last, so nothing real comes after it
+            __atomic_store_n(&shared_data->dispatch_done, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        loaded++;
+    }
+
+    team_lock(team);
+    for (int i = 0; i < loaded; i++) {
+        exam_slot_t *slot = &team->queue[team->queue_head % TEAM_QUEUE_SIZE];
+        slot->exam = exams[i];
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            slot->question_state[q] = QUESTION_FREE;
+        }
+        slot->questions_done = 0;
+        shared_data->exam_records[exams[i].exam_index].loaded_ms = run_time_ms(shared_data);
+        team->queue_head++;
+    }
+    team->batch_count = 0;
+    team->refiller = 0;
+    team_check_drained(shared_data, team, semid);
+    team_unlock(team);
+
+    if (loaded > 0) {
+        printf("TA %d: Team %d took %d exam(s) from the dispatcher\n", ta_id, my_status->team + 1, loaded);
+        // Each team reviews the rubric once per batch, while its other members mark
+        check_rubric(shared_data, ta_id, semid);
+    }
+}
+
+// Team member: claim questions from the team queue under the team lock; whoever finds it
+// short of exams refills it from the dispatcher
+static void team_process(shared_data_t *shared_data, int ta_id, int semid) {
+    team_t *team = &shared_data->teams[my_status->team];
+    while (!stop_requested(shared_data)) {
+        set_ta_state(TA_IDLE);
+
+        team_lock(team);
+        int position = -1, question = -1;
+        exam_info_t exam;
+        for (int n = team->queue_tail; n < team->queue_head && question < 0; n++) {
+            exam_slot_t *slot = &team->queue[n % TEAM_QUEUE_SIZE];
+            for (int i = 0; i < RUBRIC_SIZE; i++) {
+                if (slot->question_state[i] == QUESTION_FREE) {
+                    slot->question_state[i] = QUESTION_CLAIMED;
+                    slot->claim_owner[i] = ta_id;
+                    position = n;
+                    question = i;
+                    exam = slot->exam;
+                    break;
+                }
+            }
+        }
+        int free_slots = TEAM_QUEUE_SIZE - (team->queue_head - team->queue_tail);
+        int refill = question < 0 && team->refiller == 0 && free_slots > 0 &&
+                     (!shared_data->dispatch_done || shared_data->num_orphaned > 0);
+        if (refill) {
+            team->refiller = ta_id;
+        } else if (question < 0) {
+            team_check_drained(shared_data, team, semid);  // Teams that got no exams finish here
+        }
+        int drained = team->drained;
+        team_unlock(team);
+
+        if (question >= 0) {
+            record_question_claimed(shared_data, exam.exam_index);
+            int mark = mark_one_question(shared_data, ta_id, &exam, question);
+            record_mark(shared_data, &exam, question, mark);
+            record_question_done(shared_data, exam.exam_index);
+
+            team_lock(team);
+            exam_slot_t *slot = &team->queue[position % TEAM_QUEUE_SIZE];
+            slot->question_state[question] = QUESTION_DONE;
+            slot->questions_done++;
+            while (team->queue_tail < team->queue_head &&
+                   team->queue[team->queue_tail % TEAM_QUEUE_SIZE].questions_done == RUBRIC_SIZE) {
+                team->queue_tail++;
+            }
+            team_check_drained(shared_data, team, semid);
+            team_unlock(team);
+        } else if (refill) {
+            team_refill(shared_data, team, ta_id, semid, free_slots);
+        } else if (drained) {
+            break;
+        } else {
+            pause_ms(50);  // Team-mates are marking the last questions or refilling
+        }
+    }
+    printf("TA %d: Leaving team %d - no more exams for it\n", ta_id, my_status->team + 1);
+}
+
+// Entry point of every forked TA
+static void run_ta(shared_data_t *shared_data, int ta_id, int semid, ta_role_t role) {
+    // A chaos run is seeded so the same perturbation and marking choices can be replayed
+    srand(chaos ? chaos_seed + ta_id : (unsigned int)time(NULL) + ta_id);
+    chaos_state = chaos_seed * 2654435761u + ta_id;
+
+    my_status = &shared_data->tas[ta_id - 1];
+    for (int s = 0; s < num_shards; s++) {
+        // A sharded run's TA has a slot in every course; it is only in one at a time
+        ta_status_t *slot = &shards[s].shared_data->tas[ta_id - 1];
+        slot->pid = getpid();
+        slot->role = role;
+        slot->waiting_sem = -1;
+        slot->question = -1;
+        slot->cpu = -1;
+        slot->claim_exam = -1;
+        slot->claim_question = -1;
+        slot->holds_slot = 0;
+        slot->has_ticket = 0;
+        slot->has_team_ticket = 0;
+        slot->slab_cache.has_ticket = 0;
+        slot->slab_cache.owner = slot->pid;
+        slot->rubric_pin = -1;
+        slot->in_batch = 0;
+        slot->in_shard = 0;
+        slot->team = shared_data->num_teams > 0 ? (ta_id - 1) / shared_data->team_size : 0;
+        slot->state_since_ms = monotonic_ms();
+        if (shared_data->num_shards > 0) {
+            slot->state = TA_EXITED;
+        }
+    }
+
+    switch (role) {
+        case ROLE_LOADER:
+            loader_process(shared_data, ta_id, semid);
+            break;
+        case ROLE_REVIEWER:
+            reviewer_process(shared_data, ta_id, semid);
+            break;
+        case ROLE_MARKER:
+            marker_process(shared_data, ta_id, semid);
+            break;
+        default:
+            if (shared_data->num_teams > 0) {
+                team_process(shared_data, ta_id, semid);
+            } else if (shared_data->num_shards > 0) {
+                sharded_ta_process(ta_id);
+            } else if (shared_data->daemon_mode) {
+                daemon_ta_process(shared_data, ta_id, semid);
+            } else {
+                ta_process(shared_data, ta_id, semid);
+            }
+            break;
+    }
+    for (int s = 0; s < num_shards; s++) {
+        // Free result records this TA held back go to the other TAs (and the run report)
+        shared_data_t *course = shards[s].shared_data;
+        slab_cache_drain(&course->arena, &course->tas[ta_id - 1].slab_cache);
+    }
+    set_ta_state(TA_EXITED);
+}
+
+// Fork one TA process; the child never returns
+static pid_t spawn_ta(shared_data_t *shared_data, int semid, const run_options_t *opts, int ta_index) {
+    fflush(stdout);  // Children must not inherit buffered output
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The parent coordinates shutdown; a TA killed outright is handled as a dead TA
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_DFL);
+
+        // Child process (TA), pinned before it touches the shared state
+        int cpu = placement_cpu_for_ta(&opts->placement, ta_index);
+        if (cpu >= 0 && placement_pin_self(cpu) == -1) {
+            perror("Failed to pin TA to CPU");
+        }
+        run_ta(shared_data, ta_index + 1, semid, pipeline_role(opts, ta_index));
+        shmdt(shared_data);
+        exit(0);
+    } else if (pid < 0) {
+        perror("fork failed");
+    }
+    return pid;
+}
+
+#define RECOVERY_POLL_MS 50   // How often the parent checks for dead TAs
+
+// Parent-side record of TAs that died without exiting cleanly
+typedef struct {
+    int pending[MAX_TAS];       // TA indices whose work has not been handed back yet
+    int num_pending;
+    int respawns[MAX_TAS];      // Replacements started per TA slot
+    int deaths;
+    int total_respawns;
+    int released;               // Claims handed back to the pool
+} recovery_t;
+
+// Parent-side state of one marking run
+struct ta_engine {
+    run_options_t opts;
+    ipc_run_t ipc_run;
+    int semid;
+    shared_data_t *shared_data;
+    pid_t pids[MAX_TAS];            // 0 once reaped
+    recovery_t recovery;
+    int submitted;                  // engine_submit_exams has run
+    int started;                    // engine_start has forked the TAs
+    int live;                       // TAs not reaped yet
+    int hung;                       // The watchdog killed the TAs
+    long long last_progress;        // Watchdog: progress at the last change, and when
+    long long last_change_ms;
+    int spawned, retired, peak;     // Autoscaling: TAs started / retired, largest pool
+    long long last_idle[MAX_TAS];   // Autoscaling: idle time of each TA at the last check
+    long long last_autoscale_ms;
+};
+
+// Hand a dead TA's work back (its ticket-lock turn has already been dealt with).
+// SysV locks need nothing here: SEM_UNDO released them when the process died.
+static void release_dead_ta_work(shared_data_t *shared_data, int semid, int replaced,
+                                 recovery_t *recovery, int index) {
+    ta_status_t *ta = &shared_data->tas[index];
+    int ta_id = index + 1;
+    int work_tokens = 0, slot_tokens = 0, loaders_gone = 0;
+    ta->rubric_pin = -1;  // A dead TA reads nothing: its announced version is free to go
+
+    if (shared_data->num_teams > 0) {
+        // Team lock before the global lock, like the TAs themselves
+        team_t *team = &shared_data->teams[ta->team];
+        team_lock(team);
+        for (int n = team->queue_tail; n < team->queue_head; n++) {
+            exam_slot_t *slot = &team->queue[n % TEAM_QUEUE_SIZE];
+            for (int i = 0; i < RUBRIC_SIZE; i++) {
+                if (slot->question_state[i] == QUESTION_CLAIMED && slot->claim_owner[i] == ta_id) {
+                    slot->question_state[i] = QUESTION_FREE;
+                    recovery->released++;
+                }
+            }
+        }
+        if (team->refiller == ta_id) {
+            // Exams it took from the dispatcher but never queued go back to the dispatcher
+            shared_lock(shared_data, semid);
+            for (int i = 0; i < team->batch_count && shared_data->num_orphaned < MAX_TAS; i++) {
+                int n = shared_data->num_orphaned++;
+                shared_data->orphaned_exam[n] = team->batch_exams[i];
+                shared_data->orphaned_question[n] = -1;
+                recovery->released++;
+            }
+            shared_unlock(shared_data, semid);
+            team->batch_count = 0;
+            team->refiller = 0;
+        }
+        team_unlock(team);
+    }
+
+    shared_lock(shared_data, semid);
+    if (ta->claim_exam >= 0) {
+        if (ta->claim_question >= 0 && !shared_data->pipeline_mode &&
+            shared_data->current_exam.exam_index == ta->claim_exam &&
+            shared_data->questions_marked[ta->claim_question] == 1) {
+            // Still the current exam: simply unclaim the question
+            shared_data->questions_marked[ta->claim_question] = 0;
+        } else if (shared_data->num_orphaned < MAX_TAS) {
+            // The exam moved on (or a loader had taken it): queue it for another TA
+            int n = shared_data->num_orphaned++;
+            shared_data->orphaned_exam[n] = ta->claim_exam;
+            shared_data->orphaned_question[n] = ta->claim_question;
+        }
+        recovery->released++;
+    }
+    if (shared_data->pipeline_mode) {
+        for (int n = shared_data->queue_tail; n < shared_data->queue_head; n++) {
+            exam_slot_t *slot = &shared_data->exam_queue[n % EXAM_QUEUE_SIZE];
+            for (int i = 0; i < RUBRIC_SIZE; i++) {
+                if (slot->question_state[i] == QUESTION_CLAIMED && slot->claim_owner[i] == ta_id) {
+                    // A speculative copy in flight stays valid; otherwise the question is free again
+                    slot->question_state[i] = QUESTION_FREE;
+                    work_tokens++;
+                    recovery->released++;
+                }
+                if (slot->speculator[i] == ta_id) {
+                    slot->speculator[i] = 0;
+                }
+            }
+        }
+        if (ta->role == ROLE_MARKER) {
+            work_tokens++;  // It may have died between taking a token and claiming a question
+        }
+        slot_tokens = ta->holds_slot;
+        if (ta->role == ROLE_LOADER && !replaced) {
+            // No replacement will run the loader exit path, so do its bookkeeping here
+            if (--shared_data->active_loaders == 0) {
+                shared_data->loading_done = 1;
+                pipeline_check_finished(shared_data);
+                loaders_gone = 1;
+            }
+        }
+    }
+    ta->claim_exam = -1;
+    ta->holds_slot = 0;
+    ta->has_ticket = 0;
+    if (ta->grades_seq & 1) {
+        ta->grades_seq++;  // Died mid-update: publish its partials as they are so readers stop retrying
+    }
+    ta->state = TA_EXITED;
+    if (ta->in_batch) {
+        // Its batch token is spent: count the batch as finished for this TA
+        ta->in_batch = 0;
+        __atomic_sub_fetch(&shared_data->batch_busy_tas, 1, __ATOMIC_SEQ_CST);
+    }
+    if (ta->in_shard) {
+        ta->in_shard = 0;
+        __atomic_sub_fetch(&shared_data->shard_tas, 1, __ATOMIC_SEQ_CST);
+    }
+    shared_unlock(shared_data, semid);
+
+    sem_signal_n(semid, SEM_WORK, work_tokens + (loaders_gone ? shared_data->num_markers : 0));
+    sem_signal_n(semid, SEM_SLOTS_FREE, slot_tokens);
+}
+
+// Reap exited TAs without blocking. Returns how many are gone; dead ones are queued for recovery.
+// Only the engine's own TAs are waited for, so other children of the process are left alone.
+static int reap_tas(shared_data_t *shared_data, pid_t *pids, recovery_t *recovery) {
+    int gone = 0;
+    int status;
+    for (int index = 0; index < shared_data->num_tas; index++) {
+        pid_t pid = pids[index];
+        if (pid <= 0 || waitpid(pid, &status, WNOHANG) != pid) {
+            continue;
+        }
+        gone++;
+        pids[index] = 0;
+
+        // A clean exit always passes through TA_EXITED
+        if (shared_data->tas[index].state == TA_EXITED && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            continue;
+        }
+        if (WIFSIGNALED(status)) {
+            printf("Supervisor: TA %d (pid %d) was killed by signal %d\n", index + 1, (int)pid, WTERMSIG(status));
+        } else {
+            printf("Supervisor: TA %d (pid %d) died unexpectedly\n", index + 1, (int)pid);
+        }
+        recovery->deaths++;
+        recovery->pending[recovery->num_pending++] = index;
+    }
+    return gone;
+}
+
+// Hand back the work of dead TAs and start replacements. A dead TA that was queued for the
+// ticket lock waits here until its turn comes (the TAs ahead of it are alive, or also dead
+// and pending here). Returns how many replacements were started.
+static int recover_dead_tas(shared_data_t *primary, int primary_semid, const run_options_t *opts,
+                            pid_t *pids, recovery_t *recovery) {
+    // A TA killed inside ticket_lock_take blocks every other taker of that lock: finish or undo
+    // its take first, so the abandons below see only tickets that were really taken
+    for (int n = 0; n < recovery->num_pending; n++) {
+        int index = recovery->pending[n];
+        for (int s = 0; s < num_shards; s++) {
+            shared_data_t *course = shards[s].shared_data;
+            ta_status_t *ta = &course->tas[index];
+            ticket_lock_recover_taker(&course->shared_lock, ta->pid, &ta->lock_ticket, &ta->has_ticket);
+            if (course->num_teams > 0) {
+                ticket_lock_recover_taker(&course->teams[ta->team].lock, ta->pid, &ta->team_ticket,
+                                          &ta->has_team_ticket);
+            }
+            ticket_lock_recover_taker(&course->arena.lock, ta->slab_cache.owner, &ta->slab_cache.ticket,
+                                      &ta->slab_cache.has_ticket);
+        }
+    }
+
+    int started = 0;
+    for (int n = 0; n < recovery->num_pending; ) {
+        int index = recovery->pending[n];
+
+        // A sharded run's TA holds claims and locks only in the course it was working on
+        int shard = primary->num_shards > 0 ? primary->tas[index].shard : 0;
+        shared_data_t *shared_data = shards[shard].shared_data;
+        int semid = shards[shard].semid;
+        ta_status_t *ta = &shared_data->tas[index];
+        if (shared_data->lock_mode == LOCK_TICKET && ta->has_ticket &&
+            !ticket_lock_abandon(&shared_data->shared_lock, ta->lock_ticket)) {
+            n++;
+            continue;
+        }
+        ta->has_ticket = 0;
+        if (shared_data->num_teams > 0 && ta->has_team_ticket &&
+            !ticket_lock_abandon(&shared_data->teams[ta->team].lock, ta->team_ticket)) {
+            n++;
+            continue;
+        }
+        ta->has_team_ticket = 0;
+        if (ta->slab_cache.has_ticket && !ticket_lock_abandon(&shared_data->arena.lock, ta->slab_cache.ticket)) {
+            n++;
+            continue;
+        }
+        ta->slab_cache.has_ticket = 0;  // Its cached records stay with the slot for a replacement
+
+        // The pipeline cannot progress without a loader, so the last one is always replaced
+        // A daemon keeps its pool at full size between batches too
+        int work_left = 0;
+        for (int s = 0; s < num_shards; s++) {
+            const shared_data_t *course = shards[s].shared_data;
+            work_left |= !course->shutdown_requested &&
+                         (course->daemon_mode || !course->exams_finished || course->num_orphaned > 0);
+        }
+        int last_loader = shared_data->pipeline_mode && ta->role == ROLE_LOADER &&
+                          shared_data->active_loaders == 1;
+        int replace = (opts->respawn || last_loader || opts->daemon) && work_left && recovery->respawns[index] < MAX_RESPAWNS;
+
+        release_dead_ta_work(shared_data, semid, replace, recovery, index);
+        recovery->pending[n] = recovery->pending[--recovery->num_pending];
+
+        if (replace) {
+            pids[index] = spawn_ta(primary, primary_semid, opts, index);
+            if (pids[index] > 0) {
+                recovery->respawns[index]++;
+                recovery->total_respawns++;
+                started++;
+                printf("Supervisor: started a replacement for TA %d\n", index + 1);
+            }
+        }
+    }
+    return started;
+}
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_signals++;
+}
+
+// Parent only: SIGINT/SIGTERM start a drain. TAs ignore SIGINT so a Ctrl-C delivered to
+// the whole process group does not kill them mid-question.
+static void install_stop_handlers(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+// Broadcast a shutdown: the flag stops new work, and a token on every blocking semaphore
+// wakes each TA that is waiting so it sees the flag right away instead of at its next pass.
+// A sharded run stops every course.
+static void begin_shutdown(void) {
+    if (shards[0].shared_data->shutdown_requested) {
+        return;
+    }
+    for (int s = 0; s < num_shards; s++) {
+        shared_data_t *shared_data = shards[s].shared_data;
+        int semid = shards[s].semid;
+        shared_data->shutdown_ms = run_time_ms(shared_data);
+        __atomic_store_n(&shared_data->shutdown_requested, 1, __ATOMIC_SEQ_CST);
+        sem_signal_n(semid, SEM_WORK, shared_data->num_tas);
+        sem_signal_n(semid, SEM_SLOTS_FREE, shared_data->num_tas);
+        sem_signal_n(semid, SEM_BATCH, shared_data->num_tas);
+    }
+    printf("\nShutdown requested: TAs finish the question in hand and stop (signal again to force)\n");
+}
+
+// Called from the parent's polling loops: act on SIGINT/SIGTERM outside the handler
+static void check_stop_signals(shared_data_t *shared_data, pid_t *pids) {
+    static int handled = 0;
+    if (stop_signals == handled) {
+        return;
+    }
+    handled = stop_signals;
+    begin_shutdown();
+    if (handled == 1) {
+        return;
+    }
+    // Second signal: stop waiting for questions in progress
+    printf("Forcing shutdown: terminating the remaining TAs\n");
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGKILL);
+        }
+    }
+}
+
+static const char *role_name(int role) {
+    switch (role) {
+        case ROLE_LOADER:   return "loader";
+        case ROLE_REVIEWER: return "reviewer";
+        case ROLE_MARKER:   return "marker";
+        default:            return "all";
+    }
+}
+
+// Total work done so far; the watchdog expects it to keep moving
+static long long watchdog_progress(shared_data_t *shared_data) {
+    long long progress = shared_data->current_exam_index + shared_data->queue_head;
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        progress += shared_data->tas[i].questions_marked;
+    }
+    for (int i = 0; i < shared_data->num_teams; i++) {
+        progress += shared_data->teams[i].queue_head;
+    }
+    return progress;
+}
+
+// --watchdog: if nothing was marked or loaded for watchdog_s seconds the run is hung
+// (deadlock) or spinning (livelock). Dump what every TA is doing and kill them.
+static void check_watchdog(ta_engine_t *engine) {
+    shared_data_t *shared_data = engine->shared_data;
+    const run_options_t *opts = &engine->opts;
+    if (opts->watchdog_s <= 0 || shared_data->shutdown_requested || engine->hung) {
+        return;
+    }
+    long long progress = 0;
+    for (int s = 0; s < num_shards; s++) {
+        progress += watchdog_progress(shards[s].shared_data);
+    }
+    long long now = monotonic_ms();
+    if (progress != engine->last_progress ||
+        (shared_data->daemon_mode && __atomic_load_n(&shared_data->batch_busy_tas, __ATOMIC_SEQ_CST) == 0)) {
+        // An idle daemon is waiting for a batch, not hung
+        engine->last_progress = progress;
+        engine->last_change_ms = now;
+        return;
+    }
+    if (now - engine->last_change_ms < opts->watchdog_s * 1000LL) {
+        return;
+    }
+
+    printf("\nWatchdog: no progress for %ds at exam %d/%d\n", opts->watchdog_s,
+           shared_data->current_exam_index, shared_data->total_exams);
+    if (chaos) {
+        printf("Replay with --chaos=%u\n", chaos_seed);
+    }
+    for (int s = 0; s < num_shards; s++) {
+        const shared_data_t *course = shards[s].shared_data;
+        if (num_shards > 1) {
+            printf("  Course %d (%s): exam %d/%d\n", s + 1, course->shard_dir,
+                   course->current_exam_index, course->total_exams);
+        }
+        for (int i = 0; i < course->num_tas; i++) {
+            const ta_status_t *ta = &course->tas[i];
+            if (ta->state == TA_EXITED) {
+                continue;
+            }
+            printf("  TA %-3d %-8s state %d  waiting on sem %d  question %d  ticket %s\n", i + 1,
+                   role_name(ta->role), ta->state, ta->waiting_sem, ta->question, ta->has_ticket ? "held/queued" : "-");
+        }
+    }
+    // Nothing is recovered from here on: the run is over
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        if (engine->pids[i] > 0) {
+            kill(engine->pids[i], SIGKILL);
+            waitpid(engine->pids[i], NULL, 0);
+            engine->pids[i] = 0;
+        }
+    }
+    engine->recovery.num_pending = 0;
+    engine->live = 0;
+    engine->hung = 1;
+    fflush(stdout);
+}
+
+// Questions still waiting for a TA (consistent under the shared-state lock)
+static int backlog_questions(shared_data_t *shared_data, int semid) {
+    shared_lock(shared_data, semid);
+    int backlog = questions_waiting(shared_data);
+    shared_unlock(shared_data, semid);
+    return backlog;
+}
+
+// Idle time of a TA including the idle stretch it is in right now
+static long long ta_idle_ms(const ta_status_t *ta, long long now) {
+    long long idle = ta->idle_ms;
+    int state = ta->state;
+    if (state == TA_IDLE || state == TA_STARTING) {
+        idle += now - ta->state_since_ms;
+    }
+    return idle;
+}
+
+#define AUTOSCALE_INTERVAL_MS 500
+#define AUTOSCALE_GROW_IDLE   0.25   // Grow while TAs are idle less than this...
+#define AUTOSCALE_SHRINK_IDLE 0.50   // ...and shrink once they are idle more than this
+
+// Supervisor mode: watch the backlog and how idle the TAs are, and fork or retire
+// TAs between opts->min_tas and opts->max_tas
+static void autoscale_step(ta_engine_t *engine) {
+    shared_data_t *shared_data = engine->shared_data;
+    const run_options_t *opts = &engine->opts;
+    pid_t *pids = engine->pids;
+    int semid = engine->semid;
+
+    // Idle ratio of the running, non-retiring TAs over the last interval
+    long long now = monotonic_ms();
+    long long window = now - engine->last_autoscale_ms;
+    if (window < AUTOSCALE_INTERVAL_MS) {
+        return;
+    }
+    engine->last_autoscale_ms = now;
+    long long idle_total = 0;
+    int running = 0, most_idle = -1;
+    long long most_idle_delta = -1;
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        ta_status_t *ta = &shared_data->tas[i];
+        long long idle = ta_idle_ms(ta, now);
+        long long delta = idle - engine->last_idle[i];
+        engine->last_idle[i] = idle;
+        if (ta->state == TA_EXITED || ta->retire_requested || pids[i] <= 0) {
+            continue;
+        }
+        running++;
+        idle_total += delta;
+        if (delta > most_idle_delta) {
+            most_idle_delta = delta;
+            most_idle = i;
+        }
+    }
+    if (running == 0) {
+        return;
+    }
+    double idle_ratio = (double)idle_total / (double)(running * window);
+    int backlog = backlog_questions(shared_data, semid);
+
+    if (idle_ratio < AUTOSCALE_GROW_IDLE && backlog > running && running < opts->max_tas &&
+        engine->spawned < MAX_TAS) {
+        int index = engine->spawned;
+        pids[index] = spawn_ta(shared_data, semid, opts, index);
+        if (pids[index] > 0) {
+            engine->spawned++;
+            engine->live++;
+            shared_data->num_tas = engine->spawned;
+            if (running + 1 > engine->peak) {
+                engine->peak = running + 1;
+            }
+            printf("Supervisor: backlog %d questions, idle %.0f%% -> started TA %d (%d running)\n",
+                   backlog, idle_ratio * 100, index + 1, running + 1);
+        }
+    } else if ((idle_ratio > AUTOSCALE_SHRINK_IDLE || backlog < running) &&
+               running > opts->min_tas && most_idle >= 0) {
+        shared_data->tas[most_idle].retire_requested = 1;
+        engine->retired++;
+        printf("Supervisor: backlog %d questions, idle %.0f%% -> retiring TA %d (%d running)\n",
+               backlog, idle_ratio * 100, most_idle + 1, running - 1);
+    }
+}
+
+// One pass of the parent's supervision: signals, outside rubric edits, the watchdog, dead TAs
+// (recovered, and replaced with --respawn) and the pool size when autoscaling
+static void supervise_step(ta_engine_t *engine) {
+    shared_data_t *shared_data = engine->shared_data;
+    int semid = engine->semid;
+    if (engine->opts.handle_signals) {
+        check_stop_signals(shared_data, engine->pids);
+    }
+    check_rubric_edits();
+    check_watchdog(engine);
+    engine->live -= reap_tas(shared_data, engine->pids, &engine->recovery);
+    engine->live += recover_dead_tas(shared_data, semid, &engine->opts, engine->pids, &engine->recovery);
+    for (int s = 0; s < num_shards; s++) {
+        shards[s].shared_data->active_tas = engine->live;
+    }
+    if (engine->opts.autoscale && engine->live > 0 && !stop_requested(shared_data)) {
+        autoscale_step(engine);
+    }
+}
+
+// How evenly the shared-state lock was handed out
+typedef struct {
+    long long acquisitions;     // Total over all TAs
+    double mean_wait_ms;
+    double max_wait_ms;
+    int max_wait_ta;            // TA that saw the longest wait (1-based)
+    double min_share;           // Smallest / largest per-TA fraction of acquisitions
+    double max_share;
+    double jain_index;          // (sum x)^2 / (n * sum x^2): 1.0 = perfectly even, 1/n = one TA got everything
+} lock_fairness_t;
+
+static void compute_lock_fairness(const shared_data_t *shared_data, lock_fairness_t *fairness) {
+    memset(fairness, 0, sizeof(*fairness));
+    long long total_wait_us = 0;
+    double sum_squares = 0;
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        const ta_status_t *ta = &shared_data->tas[i];
+        fairness->acquisitions += ta->lock_acquisitions;
+        total_wait_us += ta->lock_wait_us;
+        sum_squares += (double)ta->lock_acquisitions * ta->lock_acquisitions;
+        if (ta->lock_max_wait_us / 1000.0 > fairness->max_wait_ms) {
+            fairness->max_wait_ms = ta->lock_max_wait_us / 1000.0;
+            fairness->max_wait_ta = i + 1;
+        }
+    }
+    if (fairness->acquisitions == 0) {
+        return;
+    }
+
+    fairness->mean_wait_ms = total_wait_us / 1000.0 / fairness->acquisitions;
+    fairness->jain_index = (double)fairness->acquisitions * fairness->acquisitions /
+                           (shared_data->num_tas * sum_squares);
+    fairness->min_share = 1.0;
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        double share = (double)shared_data->tas[i].lock_acquisitions / fairness->acquisitions;
+        if (share < fairness->min_share) fairness->min_share = share;
+        if (share > fairness->max_share) fairness->max_share = share;
+    }
+}
+
+static long long team_lock_total(const shared_data_t *shared_data) {
+    long long total = 0;
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        total += shared_data->tas[i].team_lock_acquisitions;
+    }
+    return total;
+}
+
+static void print_lock_report(shared_data_t *shared_data) {
+    lock_fairness_t fairness;
+    compute_lock_fairness(shared_data, &fairness);
+    printf("Shared lock (%s): %lld acquisitions, mean wait %.2fms, max wait %.2fms (TA %d)\n",
+           shared_data->lock_mode == LOCK_TICKET ? "ticket" : "sysv", fairness.acquisitions,
+           fairness.mean_wait_ms, fairness.max_wait_ms, fairness.max_wait_ta);
+    printf("  Per-TA share %.1f%%..%.1f%% (even share %.1f%%), Jain fairness index %.3f\n",
+           100 * fairness.min_share, 100 * fairness.max_share, 100.0 / shared_data->num_tas,
+           fairness.jain_index);
+    if (shared_data->num_teams > 0) {
+        printf("Team locks: %lld acquisitions over %d team(s)\n", team_lock_total(shared_data),
+               shared_data->num_teams);
+    }
+}
+
+// Nearest-rank percentile of an ascending array
+static long long percentile(const long long *sorted, int count, double pct) {
+    if (count == 0) {
+        return 0;
+    }
+    int rank = (int)(pct / 100.0 * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Latency distribution of one per-exam metric
+typedef struct {
+    const char *name;
+    long long p50, p90, p99, max;
+} latency_stats_t;
+
+static void summarize_latency(latency_stats_t *stats, const char *name, long long *values, int count) {
+    qsort(values, count, sizeof(long long), compare_ll);
+    stats->name = name;
+    stats->p50 = percentile(values, count, 50);
+    stats->p90 = percentile(values, count, 90);
+    stats->p99 = percentile(values, count, 99);
+    stats->max = count ? values[count - 1] : 0;
+}
+
+// Arena statistics plus every TA's cache (TAs that exited cleanly have drained theirs)
+static void collect_arena(const shared_data_t *shared_data, slab_report_t *report) {
+    slab_collect(&shared_data->arena, report);
+    int num_tas = shared_data->num_tas < MAX_TAS ? shared_data->num_tas : MAX_TAS;
+    for (int i = 0; i < num_tas; i++) {
+        slab_collect_cache(&shared_data->tas[i].slab_cache, report);
+    }
+}
+
+static double cache_hit_rate(const slab_report_t *report) {
+    return report->cache_allocs > 0 ? (double)report->cache_hits / report->cache_allocs : 0.0;
+}
+
+// Exams per second achieved by the startup batch load
+static double ingest_rate(const ingest_report_t *report) {
+    return report->elapsed_us > 0 ? report->loaded * 1000000.0 / report->elapsed_us : 0.0;
+}
+
+// --ingest: read every exam's header and section index into the shared catalog in one
+// batch, in schedule order, so no TA does file I/O to load an exam during the run
+static void ingest_all_exams(shared_data_t *shared_data, run_options_t *opts) {
+    ingest_report_t *report = &opts->ingest_report;
+    ingest_exams(opts->ingest, opts->ingest_depth, shared_data->schedule, shared_data->total_exams,
+                 shared_data->exam_catalog, shared_data->catalog_ready, report);
+    ingested = shared_data;  // Inherited by every TA forked from here on
+
+    printf("Ingest (%s): %d/%d exams, %lld KB in %.2fms = %.0f exams/s, queue depth max %d (mean %.1f)\n",
+           ingest_mode_name(report->mode), report->loaded, report->files, report->bytes / 1024,
+           report->elapsed_us / 1000.0, ingest_rate(report), report->max_in_flight, report->mean_in_flight);
+    if (report->note[0] != '\0') {
+        printf("Ingest fallback: %s\n", report->note);
+    }
+    if (report->loaded < report->files) {
+        printf("Ingest: %d exam(s) will be read on demand\n", report->files - report->loaded);
+    }
+}
+
+// Per-exam latency report. Every exam is submitted when the run starts, so:
+//   turnaround = start -> last question marked (what the student waits)
+//   queueing   = loaded -> first question claimed (loaded exam waiting for a TA)
+//   marking    = first claim -> last question marked
+static void print_latency_report(shared_data_t *shared_data, const run_options_t *opts) {
+    static long long turnaround[MAX_EXAMS], queueing[MAX_EXAMS], marking[MAX_EXAMS];
+    int count = 0;
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        const exam_record_t *record = &shared_data->exam_records[i];
+        if (record->completed_ms < 0 || record->first_claim_ms < 0 || record->loaded_ms < 0) {
+            continue;  // Never completed (e.g. the 9999 terminator)
+        }
+        turnaround[count] = record->completed_ms;
+        queueing[count] = record->first_claim_ms - record->loaded_ms;
+        marking[count] = record->completed_ms - record->first_claim_ms;
+        count++;
+    }
+
+    latency_stats_t stats[3];
+    summarize_latency(&stats[0], "turnaround", turnaround, count);
+    summarize_latency(&stats[1], "queueing", queueing, count);
+    summarize_latency(&stats[2], "marking", marking, count);
+
+    printf("Exam latency (%d exams, %d TAs):\n", count, shared_data->num_tas);
+    printf("  %-12s %8s %8s %8s %8s\n", "", "p50", "p90", "p99", "max");
+    for (int i = 0; i < 3; i++) {
+        printf("  %-12s %7.2fs %7.2fs %7.2fs %7.2fs\n", stats[i].name, stats[i].p50 / 1000.0,
+               stats[i].p90 / 1000.0, stats[i].p99 / 1000.0, stats[i].max / 1000.0);
+    }
+
+    if (opts->report_json == NULL) {
+        return;
+    }
+
+    // One JSON object per run, appended so runs with different TA counts can be compared
+    FILE *file = fopen(opts->report_json, "a");
+    if (file == NULL) {
+        perror("Failed to open JSON report");
+        return;
+    }
+    fprintf(file, "{\"num_tas\": %d, \"mode\": \"%s\", \"teams\": %d, \"exams\": %d, \"elapsed_ms\": %lld",
+            shared_data->num_tas, opts->pipeline ? "pipeline" : opts->team_size > 0 ? "teams" : "classic",
+            shared_data->num_teams, count, run_time_ms(shared_data));
+    if (shared_data->num_shards > 0) {
+        fprintf(file, ", \"course\": %d, \"courses\": %d, \"course_dir\": \"%s\"", shared_data->shard_index + 1,
+                shared_data->num_shards, shared_data->shard_dir);
+    }
+    lock_fairness_t fairness;
+    compute_lock_fairness(shared_data, &fairness);
+    fprintf(file, ", \"lock\": {\"lock_mode\": \"%s\", \"acquisitions\": %lld, \"mean_wait_ms\": %.3f, "
+            "\"max_wait_ms\": %.3f, \"jain_index\": %.4f, \"team_acquisitions\": %lld}",
+            shared_data->lock_mode == LOCK_TICKET ? "ticket" : "sysv", fairness.acquisitions,
+            fairness.mean_wait_ms, fairness.max_wait_ms, fairness.jain_index, team_lock_total(shared_data));
+    if (opts->ingest != INGEST_OFF) {
+        const ingest_report_t *ingest = &opts->ingest_report;
+        fprintf(file, ", \"ingest\": {\"backend\": \"%s\", \"exams\": %d, \"elapsed_us\": %lld, "
+                "\"exams_per_sec\": %.0f, \"max_depth\": %d, \"mean_depth\": %.2f}",
+                ingest_mode_name(ingest->mode), ingest->loaded, ingest->elapsed_us,
+                ingest_rate(ingest), ingest->max_in_flight, ingest->mean_in_flight);
+    }
+    for (int i = 0; i < 3; i++) {
+        fprintf(file, ", \"%s_ms\": {\"p50\": %lld, \"p90\": %lld, \"p99\": %lld, \"max\": %lld}",
+                stats[i].name, stats[i].p50, stats[i].p90, stats[i].p99, stats[i].max);
+    }
+    fprintf(file, ", \"rubric\": {\"published\": %d, \"reclaimed\": %d, \"max_live\": %d, \"older_marks\": %d}",
+            shared_data->rubric_published, shared_data->rubric_reclaimed, shared_data->rubric_max_live,
+            shared_data->rubric_older_marks);
+    grade_stats_t grades[RUBRIC_SIZE];
+    grades_collect(shared_data, grades);
+    fprintf(file, ", \"grades\": [");
+    for (int q = 0; q < RUBRIC_SIZE; q++) {
+        fprintf(file, "%s{\"question\": %d, \"n\": %lld, \"mean\": %.3f, \"sd\": %.3f}", q ? ", " : "",
+                q + 1, grades[q].count, grades[q].mean, grades_stddev(&grades[q]));
+    }
+    fprintf(file, "]");
+    slab_report_t arena;
+    collect_arena(shared_data, &arena);
+    fprintf(file, ", \"arena\": {\"slabs_used\": %d, \"peak_slabs\": %d, \"live_bytes\": %lld, "
+            "\"allocs\": %lld, \"frees\": %lld, \"failures\": %lld, \"lock_acquisitions\": %lld, "
+            "\"cache_hit_rate\": %.4f, \"internal_fragmentation\": %.4f, \"external_fragmentation\": %.4f}}\n",
+            arena.slabs_used, arena.peak_slabs, arena.live_bytes, arena.allocs, arena.frees, arena.failures,
+            arena.lock_acquisitions, cache_hit_rate(&arena), slab_internal_fragmentation(&arena),
+            slab_external_fragmentation(&arena));
+    fclose(file);
+}
+
+// Deadline report: every exam that had a deadline, and how late the missed ones were
+static void print_deadline_report(shared_data_t *shared_data) {
+    int with_deadline = 0, missed = 0;
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        const exam_record_t *record = &shared_data->exam_records[i];
+        if (record->deadline_ms == 0 || record->terminator) {
+            continue;
+        }
+        with_deadline++;
+        if (record->completed_ms < 0) {
+            missed++;
+            printf("  MISSED  exam_%04d.txt (priority %d, due %.1fs): never completed\n",
+                   i + 1, record->priority, record->deadline_ms / 1000.0);
+        } else if (record->completed_ms > record->deadline_ms) {
+            missed++;
+            printf("  MISSED  exam_%04d.txt (priority %d, due %.1fs): done at %.1fs, %.1fs late\n",
+                   i + 1, record->priority, record->deadline_ms / 1000.0, record->completed_ms / 1000.0,
+                   (record->completed_ms - record->deadline_ms) / 1000.0);
+        }
+    }
+    if (with_deadline > 0) {
+        printf("Deadlines: %d of %d missed\n", missed, with_deadline);
+    }
+}
+
+// End of run report: where everything ran
+// Per-question grade statistics, merged from every TA's partials
+static void print_grade_report(shared_data_t *shared_data) {
+    grade_stats_t stats[RUBRIC_SIZE];
+    grades_collect(shared_data, stats);
+    printf("Grades per question (out of %d):\n", MAX_MARK);
+    printf("  %-4s %5s %6s %6s    histogram:", "", "n", "mean", "sd");
+    for (int mark = 0; mark <= MAX_MARK; mark++) {
+        printf(" %3d", mark);
+    }
+    printf("\n");
+    for (int q = 0; q < RUBRIC_SIZE; q++) {
+        printf("  Q%-3d %5lld %6.2f %6.2f              ", q + 1, stats[q].count, stats[q].mean,
+               grades_stddev(&stats[q]));
+        for (int mark = 0; mark <= MAX_MARK; mark++) {
+            printf(" %3d", stats[q].histogram[mark]);
+        }
+        printf("\n");
+    }
+}
+
+// Result record arena: usage, how much of it fragmentation wastes, and how often the TA
+// caches kept allocations off the arena lock
+static void print_arena_report(shared_data_t *shared_data) {
+    slab_report_t report;
+    collect_arena(shared_data, &report);
+    printf("Result arena: %d of %d slabs in use (peak %d), %.1f KiB live, %.1f KiB cached by TAs, "
+           "%.1f KiB free in partly used slabs\n", report.slabs_used, SLAB_COUNT, report.peak_slabs,
+           report.live_bytes / 1024.0, report.cached_bytes / 1024.0, report.partial_free_bytes / 1024.0);
+    printf("  %lld allocation(s), %lld free(s), %lld failed; %lld arena lock acquisition(s), "
+           "%.0f%% of TA allocations served from their cache\n", report.allocs, report.frees,
+           report.failures, report.lock_acquisitions, cache_hit_rate(&report) * 100);
+    printf("  Fragmentation: internal %.1f%% (%lld bytes requested, %lld allocated), external %.1f%% "
+           "(largest free run %d of %d free slabs)\n", slab_internal_fragmentation(&report) * 100,
+           report.requested_bytes, report.rounded_bytes, slab_external_fragmentation(&report) * 100,
+           report.largest_free_run, report.slabs_free);
+}
+
+// --results=FILE: append every mark with its result record
+static void write_results(shared_data_t *shared_data, const char *path) {
+    FILE *file = fopen(path, "a");
+    if (file == NULL) {
+        perror("Failed to open results file");
+        return;
+    }
+    if (shared_data->num_shards > 0) {
+        fprintf(file, "# Course %d: %s\n", shared_data->shard_index + 1, shared_data->shard_dir);
+    }
+    for (int position = 0; position < shared_data->total_exams; position++) {
+        int exam_index = shared_data->schedule[position];
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            const mark_result_t *result = slab_const_ptr(&shared_data->arena,
+                                                         shared_data->exam_records[exam_index].result[q]);
+            if (result != NULL) {
+                fprintf(file, "exam_%04d.txt Q%d %d/%d TA %d rubric v%d, %d words: %s\n", exam_index + 1, q + 1,
+                        result->mark, MAX_MARK, result->ta_id, result->rubric_version, result->words,
+                        result->feedback);
+            }
+        }
+    }
+    fclose(file);
+}
+
+// End-of-run invariants (checked in --chaos runs): every question of every exam scheduled
+// before the 9999 terminator was marked exactly once, and nothing at or after it was marked.
+// Returns the number of violations.
+static int check_invariants(shared_data_t *shared_data) {
+    int violations = 0, terminator_seen = 0;
+    for (int position = 0; position < shared_data->total_exams; position++) {
+        int exam_index = shared_data->schedule[position];
+        const exam_record_t *record = &shared_data->exam_records[exam_index];
+        terminator_seen |= record->terminator;
+        int expected = terminator_seen ? 0 : 1;
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            if (record->mark_count[q] != expected) {
+                printf("Invariant violated: exam_%04d.txt Q%d marked %d time(s), expected %d\n",
+                       exam_index + 1, q + 1, record->mark_count[q], expected);
+                violations++;
+            }
+        }
+        if (!terminator_seen && record->questions_done != RUBRIC_SIZE) {
+            printf("Invariant violated: exam_%04d.txt has %d/%d questions done\n", exam_index + 1,
+                   record->questions_done, RUBRIC_SIZE);
+            violations++;
+        }
+    }
+    if (violations == 0) {
+        printf("Invariants hold: every exam before the terminator marked exactly once (seed %u)\n", chaos_seed);
+    } else {
+        printf("%d invariant violation(s) - replay with --chaos=%u\n", violations, chaos_seed);
+    }
+    return violations;
+}
+
+// Rubric versioning: versions published and reclaimed, and whether each exam's marks all
+// came from one rubric version
+static void print_rubric_report(shared_data_t *shared_data) {
+    int single = 0, mixed = 0;
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        const exam_record_t *record = &shared_data->exam_records[i];
+        int version = -1, same = 1, marks = 0;
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            if (record->mark[q] < 0) {
+                continue;
+            }
+            if (marks++ > 0 && record->mark_rubric_version[q] != version) {
+                same = 0;
+            }
+            version = record->mark_rubric_version[q];
+        }
+        if (marks > 0) {
+            single += same;
+            mixed += !same;
+        }
+    }
+    printf("Rubric versions: %d published, %d reclaimed, at most %d held at once\n",
+           shared_data->rubric_published, shared_data->rubric_reclaimed, shared_data->rubric_max_live);
+    printf("  %d exam(s) marked against a single version, %d mixed; %d mark(s) used a pinned version "
+           "older than the newest\n", single, mixed, shared_data->rubric_older_marks);
+}
+
+// How long the batch ran on after its last useful work (or after a shutdown request)
+static void print_shutdown_report(shared_data_t *shared_data) {
+    long long now = run_time_ms(shared_data);
+    long long last_done = 0;
+    int incomplete = 0;
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        const exam_record_t *record = &shared_data->exam_records[i];
+        if (record->completed_ms > last_done) {
+            last_done = record->completed_ms;
+        }
+        incomplete += (record->completed_ms < 0 && !record->terminator);
+    }
+
+    if (!shared_data->shutdown_requested) {
+        printf("Last exam completed at %.2fs, all TAs gone %.2fs later\n", last_done / 1000.0,
+               (now - last_done) / 1000.0);
+        return;
+    }
+    printf("Shutdown requested at %.2fs, all TAs gone %.2fs later; %d exam(s) left incomplete",
+           shared_data->shutdown_ms / 1000.0, (now - shared_data->shutdown_ms) / 1000.0, incomplete);
+    const char *separator = ": ";
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        const exam_record_t *record = &shared_data->exam_records[i];
+        if (record->completed_ms < 0 && !record->terminator) {
+            printf("%sexam_%04d.txt (%d/%d)", separator, i + 1, record->questions_done, RUBRIC_SIZE);
+            separator = ", ";
+        }
+    }
+    printf("\n");
+}
+
+static void print_recovery_report(shared_data_t *shared_data, const recovery_t *recovery) {
+    if (recovery->deaths == 0) {
+        return;
+    }
+    printf("Recovery: %d TA(s) died, %d claim(s) handed back, %d replacement(s) started",
+           recovery->deaths, recovery->released, recovery->total_respawns);
+    if (shared_data->num_orphaned > 0) {
+        printf(", %d piece(s) of work lost (no TA left to take them)", shared_data->num_orphaned);
+    }
+    printf("\n");
+}
+
+// Sharded run: how the pool's work split over the courses
+static void print_shard_report(void) {
+    long long questions = 0, elapsed = 0;
+    printf("\n===== Courses =====\n");
+    for (int s = 0; s < num_shards; s++) {
+        const shared_data_t *course = shards[s].shared_data;
+        int exams = 0, done = 0;
+        long long last_done = 0, marked = 0;
+        for (int i = 0; i < course->total_exams; i++) {
+            const exam_record_t *record = &course->exam_records[i];
+            marked += record->questions_done;
+            if (record->completed_ms >= 0) {
+                done++;
+                last_done = record->completed_ms > last_done ? record->completed_ms : last_done;
+            }
+        }
+        exams = course->total_exams;
+        questions += marked;
+        elapsed = last_done > elapsed ? last_done : elapsed;
+        printf("  Course %d: %d/%d exams, %lld questions marked, last exam done at %.2fs, "
+               "%d TA arrival(s) from other courses  (%s)\n", s + 1, done, exams, marked,
+               last_done / 1000.0, course->shard_arrivals, course->shard_dir);
+    }
+    if (elapsed > 0) {
+        printf("  All courses: %lld questions in %.2fs (%.1f questions/s)\n", questions, elapsed / 1000.0,
+               questions * 1000.0 / elapsed);
+    }
+}
+
+static void print_run_summary(shared_data_t *shared_data, const run_options_t *opts) {
+    // Completed records, not current_exam_index: pipeline loaders advance that past the end
+    int completed = 0;
+    for (int i = 0; i < shared_data->total_exams; i++) {
+        completed += shared_data->exam_records[i].completed_ms >= 0;
+    }
+    printf("\n===== Run summary =====\n");
+    printf("Exams: %d   Elapsed: %.1fs   Rubric version: %d\n",
+           completed, (monotonic_ms() - shared_data->start_time_ms) / 1000.0,
+           shared_data->rubric_version);
+    if (shared_data->rubric_reloads > 0) {
+        printf("Rubric reloaded from outside edits %d time(s), %d TA correction(s) overridden\n",
+               shared_data->rubric_reloads, shared_data->rubric_reload_conflicts);
+    }
+    print_latency_report(shared_data, opts);
+    print_lock_report(shared_data);
+    print_deadline_report(shared_data);
+    if (opts->speed_aware) {
+        printf("Speed-aware assignment: %d tail deferral(s)", shared_data->tail_deferrals);
+        if (opts->speculate) {
+            printf(", %d speculative re-mark(s): %d won, %d wasted", shared_data->speculative_started,
+                   shared_data->speculative_won, shared_data->speculative_wasted);
+        }
+        printf("\n");
+    }
+
+    int node = placement_memory_node(shared_data);
+    if (opts->placement.numa_node >= 0) {
+        printf("Shared segment: requested NUMA node %d, resides on node %d\n",
+               opts->placement.numa_node, node);
+    } else {
+        printf("Shared segment: default NUMA policy, resides on node %d\n", node);
+    }
+
+    printf("TA placement: %s\n", placement_mode_name(opts->placement.mode));
+    for (int i = 0; i < shared_data->num_tas; i++) {
+        const ta_status_t *ta = &shared_data->tas[i];
+        int pinned = placement_cpu_for_ta(&opts->placement, i);
+        printf("  TA %-3d %-8s %s CPU %-3d (socket %d)  migrations: %d  questions marked: %d  (%.2fs each)"
+               "  lock: %d taken, max wait %.2fms\n",
+               i + 1, role_name(ta->role), pinned >= 0 ? "pinned to" : "last on  ", ta->cpu,
+               placement_cpu_socket(ta->cpu), ta->migrations, ta->questions_marked,
+               ta->marking_ewma_ms / 1000.0, ta->lock_acquisitions, ta->lock_max_wait_us / 1000.0);
+    }
+}
+
+void engine_defaults(run_options_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->placement.mode = PIN_NONE;
+    opts->placement.numa_node = -1;
+    opts->ingest_depth = INGEST_DEFAULT_DEPTH;
+    opts->time_scale = 1.0;
+}
+
+int engine_check_options(run_options_t *opts) {
+    if (opts->num_tas < 2) {
+        printf("Number of TAs must be at least 2\n");
+        return -1;
+    }
+    if (opts->num_tas > MAX_TAS) {
+        printf("Number of TAs must be at most %d\n", MAX_TAS);
+        return -1;
+    }
+    if (opts->time_scale <= 0) {
+        printf("Invalid time scale: %g\n", opts->time_scale);
+        return -1;
+    }
+
+    if (opts->autoscale) {
+        if (opts->pipeline) {
+            printf("--autoscale cannot be combined with --pipeline\n");
+            return -1;
+        }
+        // The starting size is clamped into the autoscaling range
+        if (opts->num_tas < opts->min_tas) opts->num_tas = opts->min_tas;
+        if (opts->num_tas > opts->max_tas) opts->num_tas = opts->max_tas;
+    }
+
+    if (opts->team_size > 0) {
+        if (opts->pipeline || opts->autoscale) {
+            printf("--teams cannot be combined with --pipeline or --autoscale\n");
+            return -1;
+        }
+        if ((opts->num_tas + opts->team_size - 1) / opts->team_size > MAX_TEAMS) {
+            printf("--teams=%d gives more than %d teams for %d TAs\n", opts->team_size, MAX_TEAMS, opts->num_tas);
+            return -1;
+        }
+    }
+
+    if (opts->daemon && (opts->pipeline || opts->team_size > 0 || opts->autoscale)) {
+        printf("--daemon runs classic TAs: it cannot be combined with --pipeline, --teams or --autoscale\n");
+        return -1;
+    }
+
+    if (opts->num_shards > 0) {
+        if (opts->num_shards > MAX_SHARDS) {
+            printf("--shards takes at most %d courses\n", MAX_SHARDS);
+            return -1;
+        }
+        if (opts->pipeline || opts->team_size > 0 || opts->autoscale || opts->daemon || opts->ingest != INGEST_OFF) {
+            printf("--shards runs classic TAs: it cannot be combined with --pipeline, --teams, --autoscale, "
+                   "--daemon or --ingest\n");
+            return -1;
+        }
+        for (int s = 0; s < opts->num_shards; s++) {
+            if (opts->shard_dirs[s] == NULL || opts->shard_exams[s] < 0 || opts->shard_exams[s] > MAX_EXAMS) {
+                printf("Course %d: expected DIR or DIR:EXAMS with at most %d exams\n", s + 1, MAX_EXAMS);
+                return -1;
+            }
+        }
+    }
+
+    if (opts->speculate && !opts->pipeline) {
+        printf("--speculate needs --pipeline (only queued exams track question owners)\n");
+        return -1;
+    }
+
+    if (opts->pipeline) {
+        if (opts->num_loaders + opts->num_reviewers + opts->num_markers == 0) {
+            pipeline_auto_roles(opts);
+        }
+        if (opts->num_loaders < 1 || opts->num_markers < 1 || opts->num_reviewers < 0 ||
+            opts->num_loaders + opts->num_reviewers + opts->num_markers != opts->num_tas) {
+            printf("Pipeline roles must add up to %d TAs with at least one loader and one marker\n",
+                   opts->num_tas);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Daemon: hand the previous batch's result records back to the arena
+static void release_results(shared_data_t *shared_data) {
+    for (int i = 0; i < MAX_EXAMS; i++) {
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            slab_free(&shared_data->arena, NULL, shared_data->exam_records[i].result[q]);
+            shared_data->exam_records[i].result[q] = SLAB_NULL;
+        }
+    }
+}
+
+// Per-run exam state: progress, records, the catalog, orphaned work and the TAs' marking
+// statistics. Also run before every daemon batch, while all TAs are parked on SEM_BATCH.
+static void reset_exam_state(shared_data_t *shared_data) {
+    shared_data->current_exam_index = 0;
+    shared_data->exams_finished = 0;
+    shared_data->num_orphaned = 0;
+    shared_data->start_time_ms = monotonic_ms();
+    memset(&shared_data->current_exam, 0, sizeof(shared_data->current_exam));
+    memset(shared_data->questions_marked, 0, sizeof(shared_data->questions_marked));
+    memset(shared_data->exam_records, 0, sizeof(shared_data->exam_records));
+    memset(shared_data->catalog_ready, 0, sizeof(shared_data->catalog_ready));
+
+    for (int i = 0; i < MAX_EXAMS; i++) {
+        shared_data->exam_records[i].loaded_ms = -1;
+        shared_data->exam_records[i].first_claim_ms = -1;
+        shared_data->exam_records[i].completed_ms = -1;
+        shared_data->exam_records[i].rubric_version = -1;
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            shared_data->exam_records[i].mark[q] = -1;
+            shared_data->exam_records[i].mark_rubric_version[q] = -1;
+            shared_data->exam_records[i].result[q] = SLAB_NULL;
+        }
+    }
+
+    // Per-TA counters and grade partials, so a daemon batch reports only its own marking
+    for (int i = 0; i < MAX_TAS; i++) {
+        ta_status_t *ta = &shared_data->tas[i];
+        ta->questions_marked = 0;
+        ta->migrations = 0;
+        ta->lock_acquisitions = 0;
+        ta->lock_wait_us = 0;
+        ta->lock_max_wait_us = 0;
+        ta->team_lock_acquisitions = 0;
+        memset(ta->grades, 0, sizeof(ta->grades));
+    }
+}
+
+// Create, attach and initialize one segment and its semaphore set (every course of a
+// sharded run gets its own), NULL on failure with the IPC objects already removed
+static shared_data_t *create_segment(run_options_t *opts, ipc_run_t *ipc_run) {
+    // Create private semaphores and shared memory so concurrent runs never collide
+    if (ipc_create_semaphores(ipc_run, NUM_SEMAPHORES) == -1) {
+        return NULL;
+    }
+    ipc_register_run(ipc_run);
+
+    // Initialize semaphores
+    union semun arg;
+    unsigned short values[NUM_SEMAPHORES] = {1, 1, 1, EXAM_QUEUE_SIZE, 0, 0};  // Binary locks, then counters
+    arg.array = values;
+    if (semctl(ipc_run->semid, 0, SETALL, arg) == -1) {
+        perror("semctl SETALL failed");
+        ipc_destroy_run(ipc_run);
+        return NULL;
+    }
+
+    // Create shared memory
+    if (ipc_create_backed_segment(ipc_run, sizeof(shared_data_t), &opts->backing) == -1) {
+        ipc_destroy_run(ipc_run);
+        return NULL;
+    }
+    ipc_register_run(ipc_run);
+
+    // Attach shared memory
+    shared_data_t *shared_data = (shared_data_t *)shmat(ipc_run->shmid, (char *)0, 0);
+    if (shared_data == (void *)-1) {
+        perror("shmat failed");
+        ipc_destroy_run(ipc_run);
+        return NULL;
+    }
+
+    // Place the segment on the requested NUMA node before anything touches it
+    if (opts->placement.numa_node >= 0 &&
+        placement_bind_memory(shared_data, opts->backing.size, opts->placement.numa_node) == -1) {
+        perror("Failed to bind shared memory to NUMA node (using default policy)");
+    }
+    ipc_prepare_segment(shared_data, &opts->backing);
+
+    // Mark the segment for removal now: it lives until the last TA detaches,
+    // so even a crashed run cannot leak it (forked TAs inherit the attachment)
+    shmctl(ipc_run->shmid, IPC_RMID, NULL);
+
+    // Initialize shared data
+    reset_exam_state(shared_data);
+    shared_data->rubric_version = 0;
+    shared_data->num_tas = opts->num_tas;
+    shared_data->daemon_mode = opts->daemon;
+    for (int i = 0; i < RUBRIC_HISTORY; i++) {
+        shared_data->rubric_history[i].version = -1;
+    }
+    for (int i = 0; i < MAX_TAS; i++) {
+        shared_data->tas[i].rubric_pin = -1;
+    }
+    shared_data->rubric_current = -1;
+    shared_data->speed_aware = opts->speed_aware;
+    shared_data->speculate = opts->speculate;
+    shared_data->lock_mode = opts->lock_mode;
+    ticket_lock_init(&shared_data->shared_lock);
+    slab_init(&shared_data->arena);
+    return shared_data;
+}
+
+// Sharded run: a segment, semaphore set and directory for every course after the first
+// (which uses the engine's own), -1 if a course cannot be set up
+static int create_shards(run_options_t *opts) {
+    home_dir_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (home_dir_fd == -1) {
+        perror("Failed to open the working directory");
+        return -1;
+    }
+    for (int s = 0; s < opts->num_shards; s++) {
+        if (s > 0) {
+            ipc_run_t ipc_run = {getpid(), -1, -1, s};
+            shared_data_t *shared_data = create_segment(opts, &ipc_run);
+            if (shared_data == NULL) {
+                return -1;
+            }
+            shards[s] = (shard_t){ipc_run, ipc_run.semid, shared_data, -1, -1, 0};
+            num_shards = s + 1;
+        }
+
+        shared_data_t *shared_data = shards[s].shared_data;
+        char resolved[PATH_MAX];
+        const char *dir = opts->shard_dirs[s];
+        shards[s].dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (shards[s].dir_fd == -1 || realpath(dir, resolved) == NULL ||
+            strlen(resolved) >= sizeof(shared_data->shard_dir)) {
+            printf("Course %d: ", s + 1);
+            fflush(stdout);
+            perror(dir);
+            return -1;
+        }
+        strcpy(shared_data->shard_dir, resolved);
+        shared_data->num_shards = opts->num_shards;
+        shared_data->shard_index = s;
+    }
+    return 0;
+}
+
+ta_engine_t *engine_create(const run_options_t *options) {
+    ta_engine_t *engine = calloc(1, sizeof(ta_engine_t));
+    if (engine == NULL) {
+        perror("Failed to allocate the engine");
+        return NULL;
+    }
+    engine->opts = *options;
+    run_options_t *opts = &engine->opts;
+    if (engine_check_options(opts) == -1) {
+        free(engine);
+        return NULL;
+    }
+    time_scale = opts->time_scale;
+    chaos = opts->chaos;
+    chaos_seed = opts->chaos_seed;
+    chaos_state = chaos_seed;
+
+    engine->ipc_run = (ipc_run_t){getpid(), -1, -1, 0};
+    shared_data_t *shared_data = create_segment(opts, &engine->ipc_run);
+    if (shared_data == NULL) {
+        free(engine);
+        return NULL;
+    }
+    engine->semid = engine->ipc_run.semid;
+    engine->shared_data = shared_data;
+    shards[0] = (shard_t){engine->ipc_run, engine->semid, shared_data, -1, -1, 0};
+    num_shards = 1;
+    if (opts->num_shards > 0 && create_shards(opts) == -1) {
+        engine_destroy(engine);
+        return NULL;
+    }
+    ipc_print_backing(&opts->backing);
+
+    // Load the initial rubric (a daemon loads each batch's own)
+    if (opts->daemon) {
+        return engine;
+    }
+    for (int s = 0; s < num_shards; s++) {
+        enter_shard_dir(s);
+        int loaded = load_rubric(shards[s].shared_data);
+        leave_shard_dir();
+        if (loaded == -1) {
+            engine_destroy(engine);
+            return NULL;
+        }
+        publish_rubric(shards[s].shared_data, 1);  // Version 0
+    }
+    return engine;
+}
+
+// Exam count, manifest, schedule and the optional batch load, before any TA looks at them
+// (every course of a sharded run, each from its own directory)
+static int submit_exams(ta_engine_t *engine, int count) {
+    if (count < 1 || count > MAX_EXAMS) {
+        printf("Exam count must be between 1 and %d\n", MAX_EXAMS);
+        return -1;
+    }
+    for (int s = 0; s < num_shards; s++) {
+        shared_data_t *shared_data = shards[s].shared_data;
+        shared_data->total_exams = engine->opts.shard_exams[s] > 0 ? engine->opts.shard_exams[s] : count;
+
+        // Priority/deadline schedule, fixed before any TA starts
+        enter_shard_dir(s);
+        int loaded = engine->opts.manifest == NULL || load_manifest(shared_data, engine->opts.manifest) == 0;
+        if (loaded) {
+            build_schedule(shared_data);
+        }
+        leave_shard_dir();
+        if (!loaded) {
+            return -1;
+        }
+    }
+    if (engine->opts.ingest != INGEST_OFF) {
+        ingest_all_exams(engine->shared_data, &engine->opts);
+    }
+    return 0;
+}
+
+int engine_submit_exams(ta_engine_t *engine, int count) {
+    if (engine->started || engine->submitted || engine->opts.daemon) {
+        printf("Exams must be submitted once, before the TAs start (daemons take batches)\n");
+        return -1;
+    }
+    if (submit_exams(engine, count) == -1) {
+        return -1;
+    }
+    engine->submitted = 1;
+    return 0;
+}
+
+// Sharded run: spread the pool over the courses in proportion to their backlog, with the
+// rule the TAs use themselves (each TA goes where the backlog per TA is highest)
+static void place_tas_by_backlog(int num_tas) {
+    int placed[MAX_SHARDS] = {0};
+    for (int i = 0; i < num_tas; i++) {
+        int best = 0;
+        for (int s = 1; s < num_shards; s++) {
+            long long backlog = shard_backlog(shards[s].shared_data);
+            long long best_backlog = shard_backlog(shards[best].shared_data);
+            if (backlog * (placed[best] + 1) > best_backlog * (placed[s] + 1)) {
+                best = s;
+            }
+        }
+        shards[0].shared_data->tas[i].shard = best;
+        placed[best]++;
+    }
+    printf("Sharded run: %d course(s), one TA pool of %d\n", num_shards, num_tas);
+    for (int s = 0; s < num_shards; s++) {
+        const shared_data_t *shared_data = shards[s].shared_data;
+        printf("  Course %d: %s, %d exam(s), %d TA(s) to start with\n", s + 1, shared_data->shard_dir,
+               shared_data->total_exams, placed[s]);
+    }
+}
+
+int engine_start(ta_engine_t *engine) {
+    shared_data_t *shared_data = engine->shared_data;
+    const run_options_t *opts = &engine->opts;
+    int num_tas = opts->num_tas;
+    if ((!engine->submitted && !opts->daemon) || engine->started) {
+        printf("The TAs start once, after the exams are submitted\n");
+        return -1;
+    }
+
+    // Load the first exam (pipeline loaders and teams start from exam 0 themselves,
+    // and daemon TAs wait for a batch)
+    if (opts->daemon) {
+        printf("Daemon mode: %d TAs waiting for batches\n", num_tas);
+    } else if (opts->pipeline) {
+        shared_data->pipeline_mode = 1;
+        shared_data->active_loaders = opts->num_loaders;
+        shared_data->num_markers = opts->num_markers;
+        printf("Pipeline mode: %d loader(s), %d rubric reviewer(s), %d marker(s)\n",
+               opts->num_loaders, opts->num_reviewers, opts->num_markers);
+    } else if (opts->team_size > 0) {
+        // Teams fill their own queues from the dispatcher, starting at schedule position 0
+        shared_data->team_size = opts->team_size;
+        shared_data->num_teams = (num_tas + opts->team_size - 1) / opts->team_size;
+        for (int i = 0; i < shared_data->num_teams; i++) {
+            ticket_lock_init(&shared_data->teams[i].lock);
+        }
+        printf("Team mode: %d team(s) of up to %d TAs\n", shared_data->num_teams, opts->team_size);
+    } else {
+        for (int s = 0; s < num_shards; s++) {
+            enter_shard_dir(s);
+            load_exam_file(shards[s].shared_data, scheduled_exam(shards[s].shared_data, 0));
+            shards[s].shared_data->magic = SHARED_MAGIC;
+        }
+        leave_shard_dir();
+    }
+    if (opts->num_shards > 0) {
+        place_tas_by_backlog(num_tas);
+    }
+    shared_data->magic = SHARED_MAGIC;  // Monitors may attach from here on
+    printf("Monitor this run with: ./ta_stat %d\n", (int)getpid());
+
+    // Create TA processes
+    if (opts->handle_signals) {
+        install_stop_handlers();
+    }
+    if (!opts->daemon) {
+        open_rubric_watch();
+    }
+    for (int i = 0; i < num_tas; i++) {
+        engine->pids[i] = spawn_ta(shared_data, engine->semid, opts, i);
+        if (engine->pids[i] < 0) {
+            engine->pids[i] = 0;
+            shared_data->num_tas = i;
+            engine->live = i;
+            engine_stop(engine);
+            return -1;
+        }
+    }
+    engine->started = 1;
+    engine->live = num_tas;
+    engine->spawned = num_tas;
+    engine->peak = num_tas;
+    engine->last_progress = -1;
+    engine->last_autoscale_ms = monotonic_ms();
+    shared_data->active_tas = num_tas;
+    if (opts->autoscale) {
+        printf("Supervisor: autoscaling between %d and %d TAs\n", opts->min_tas, opts->max_tas);
+    }
+    return 0;
+}
+
+int engine_poll(ta_engine_t *engine, engine_progress_t *progress) {
+    shared_data_t *shared_data = engine->shared_data;
+    int running = engine->live > 0 || engine->recovery.num_pending > 0;
+    if (engine->started && running) {
+        supervise_step(engine);
+        running = engine->live > 0 || engine->recovery.num_pending > 0;
+    }
+
+    if (progress != NULL) {
+        memset(progress, 0, sizeof(*progress));
+        for (int s = 0; s < num_shards; s++) {
+            const shared_data_t *course = shards[s].shared_data;
+            progress->total_exams += course->total_exams;
+            for (int i = 0; i < course->total_exams; i++) {
+                if (course->exam_records[i].completed_ms >= 0) {
+                    progress->exams_completed++;
+                }
+                progress->questions_marked += course->exam_records[i].questions_done;
+            }
+        }
+        progress->batch_id = shared_data->batch_id;
+        progress->active_tas = engine->live;
+        progress->rubric_version = shared_data->rubric_version;
+        progress->elapsed_ms = run_time_ms(shared_data);
+        progress->shutdown_requested = shared_data->shutdown_requested;
+        progress->finished = engine->started && !running;
+    }
+    return running;
+}
+
+int engine_begin_batch(ta_engine_t *engine, const char *dir, int count) {
+    shared_data_t *shared_data = engine->shared_data;
+    if (!engine->opts.daemon || !engine->started || shared_data->shutdown_requested ||
+        !engine_batch_done(engine)) {
+        printf("Batches need an idle daemon engine\n");
+        return -1;
+    }
+    char resolved[PATH_MAX];
+    if (realpath(dir, resolved) == NULL || strlen(resolved) >= sizeof(shared_data->batch_dir) ||
+        chdir(resolved) == -1) {
+        perror("Invalid batch directory");
+        return -1;
+    }
+
+    // Every TA is parked on SEM_BATCH, so the per-batch state can be reset without locks
+    release_results(shared_data);
+    reset_exam_state(shared_data);
+    if (load_rubric(shared_data) == -1 || submit_exams(engine, count) == -1) {
+        shared_data->total_exams = 0;
+        shared_data->exams_finished = 1;
+        return -1;
+    }
+    shared_data->rubric_version++;  // A new batch's rubric is always a new version
+    publish_rubric(shared_data, 1); // Older versions are unpinned now and get reclaimed
+    move_rubric_watch();            // Edits of the previous batch's rubric no longer count
+    load_exam_file(shared_data, scheduled_exam(shared_data, 0));
+    strcpy(shared_data->batch_dir, resolved);
+
+    // Wake the pool: one token per live TA
+    int batch = ++shared_data->batch_id;
+    __atomic_store_n(&shared_data->batch_busy_tas, engine->live, __ATOMIC_SEQ_CST);
+    sem_signal_n(engine->semid, SEM_BATCH, engine->live);
+    return batch;
+}
+
+int engine_batch_done(ta_engine_t *engine) {
+    shared_data_t *shared_data = engine->shared_data;
+    if (__atomic_load_n(&shared_data->batch_busy_tas, __ATOMIC_SEQ_CST) > 0) {
+        return 0;
+    }
+    if (shared_data->num_orphaned > 0 && !shared_data->shutdown_requested && engine->live > 0) {
+        // A TA died on the batch's last question after the others had finished: wake one more
+        __atomic_add_fetch(&shared_data->batch_busy_tas, 1, __ATOMIC_SEQ_CST);
+        sem_signal(engine->semid, SEM_BATCH);
+        return 0;
+    }
+    return 1;
+}
+
+void engine_stop(ta_engine_t *engine) {
+    (void)engine;  // One engine per process: its segments are the ones in shards[]
+    begin_shutdown();
+}
+
+int engine_wait(ta_engine_t *engine) {
+    if (!engine->started) {
+        return ENGINE_OK;
+    }
+    // Parent process waits for all TAs to finish (growing and shrinking the pool if autoscaling)
+    while (engine_poll(engine, NULL) > 0) {
+        usleep(RECOVERY_POLL_MS * 1000);
+    }
+    if (engine->hung) {
+        return ENGINE_HUNG;
+    }
+
+    // A drained run stops early by design, so only complete runs are checked
+    if (engine->shared_data->shutdown_requested) {
+        for (int s = 0; s < num_shards; s++) {
+            if (!shards[s].shared_data->exams_finished) {
+                return ENGINE_INTERRUPTED;
+            }
+        }
+    }
+    int violations = 0;
+    for (int s = 0; chaos && !engine->shared_data->shutdown_requested && s < num_shards; s++) {
+        enter_shard_dir(s);
+        violations += check_invariants(shards[s].shared_data);
+    }
+    leave_shard_dir();
+    return violations > 0 ? ENGINE_VIOLATION : ENGINE_OK;
+}
+
+void engine_print_report(ta_engine_t *engine) {
+    shared_data_t *shared_data = engine->shared_data;
+    if (engine->opts.autoscale) {
+        printf("Supervisor: pool ranged %d-%d TAs (peak %d), %d started, %d retired\n",
+               engine->opts.min_tas, engine->opts.max_tas, engine->peak, engine->spawned, engine->retired);
+    }
+    for (int s = 0; s < num_shards; s++) {
+        shared_data_t *course = shards[s].shared_data;
+        if (engine->opts.num_shards > 0) {
+            printf("\n===== Course %d of %d: %s =====", s + 1, num_shards, course->shard_dir);
+        }
+        print_run_summary(course, &engine->opts);
+        print_grade_report(course);
+        print_arena_report(course);
+        print_rubric_report(course);
+        print_shutdown_report(course);
+        if (engine->opts.results != NULL) {
+            write_results(course, engine->opts.results);
+        }
+    }
+    if (engine->opts.num_shards > 0) {
+        print_shard_report();
+    }
+    print_recovery_report(shared_data, &engine->recovery);
+}
+
+void engine_destroy(ta_engine_t *engine) {
+    for (int i = 0; i < MAX_TAS; i++) {
+        if (engine->pids[i] > 0) {
+            kill(engine->pids[i], SIGKILL);
+            waitpid(engine->pids[i], NULL, 0);
+        }
+    }
+    close_rubric_watch();
+    ingested = NULL;
+
+    // Cleanup (segment and semaphores) and drop the registry entry
+    for (int s = 1; s < num_shards; s++) {
+        shmdt(shards[s].shared_data);
+        ipc_destroy_run(&shards[s].ipc_run);
+    }
+    for (int s = 0; s < num_shards; s++) {
+        if (shards[s].dir_fd >= 0) {
+            close(shards[s].dir_fd);
+        }
+    }
+    if (home_dir_fd >= 0) {
+        close(home_dir_fd);
+        home_dir_fd = -1;
+    }
+    num_shards = 1;
+    shmdt(engine->shared_data);
+    ipc_destroy_run(&engine->ipc_run);
+    free(engine);
+}
@@ -0,0 +1,127 @@
+#ifndef TA_ENGINE_H
+#define TA_ENGINE_H
+
+#include "ta_ipc.h"
+#include "ta_shared.h"
+#include "ta_placement.h"
+#include "ta_ingest.h"
+
+// The Part B marking engine as a library (libta_engine.a / libta_engine.so). ta_partB is a
+// command line front end over it; a service can link it and keep an engine in-process.
+//
+//   run_options_t opts;
+//   engine_defaults(&opts);
+//   opts.num_tas = 8;
+//   ta_engine_t *engine = engine_create(&opts);   // IPC objects, segment, rubric
+//   engine_submit_exams(engine, 20);               // exam_0001.txt .. exam_0020.txt
+//   engine_start(engine);                          // fork the TAs
+//   while (engine_poll(engine, &progress) > 0) { ... }   // or engine_wait(engine)
+//   engine_print_report(engine);
+//   engine_destroy(engine);
+//
+// TAs are forked processes, so only one engine may run per process at a time. The engine
+// reaps only its own TAs and never installs signal handlers unless handle_signals is set.
+//
+// A sharded engine (opts.num_shards) marks several courses with one TA pool. Every course
+// directory has its own rubric.txt and exam files, and gets its own segment and semaphores.
+
+#define MAX_RESPAWNS 3      // Per TA slot, so a TA that always crashes cannot loop forever
+
+// Engine configuration (ta_partB fills it from its command line)
+typedef struct {
+    int num_tas;
+    int reap;                  // --reap: only clean up orphaned runs
+    placement_t placement;     // --pin / --numa-node
+    ipc_backing_t backing;     // --hugepages / --mlock / --prefault
+    int pipeline;              // --pipeline: dedicated loader / reviewer / marker roles
+    int num_loaders;
+    int num_reviewers;
+    int num_markers;
+    int autoscale;             // --autoscale=MIN:MAX: supervisor grows and shrinks the pool
+    int min_tas;
+    int max_tas;
+    const char *manifest;      // --manifest=FILE: per-exam priority and deadline
+    const char *report_json;   // --report-json=FILE: append a machine-readable run report
+    const char *results;       // --results=FILE: append every mark with its feedback
+    int lock_mode;             // --lock=sysv|ticket: shared-state lock implementation
+    int respawn;               // --respawn: replace TAs that die mid-run
+    int team_size;             // --teams=SIZE: two-level coordination (0 = off)
+    int speed_aware;           // --speed-aware: steer tail questions to faster TAs
+    int speculate;             // --speculate: re-mark stragglers (pipeline mode)
+    int watchdog_s;            // --watchdog=SECONDS: abort if no question is marked for this long (0 = off)
+    ingest_mode_t ingest;      // --ingest=uring|threads: load every exam in one batch at startup
+    int ingest_depth;          // --ingest-depth=N: I/O requests in flight
+    ingest_report_t ingest_report;  // Filled in by the batch load
+    double time_scale;         // --time-scale=F: multiplies every simulated delay
+    int chaos;                 // --chaos=SEED: seeded random yields/delays at every lock operation
+    unsigned int chaos_seed;
+    int handle_signals;        // SIGINT/SIGTERM drain the run (second one kills the TAs)
+    int daemon;                // --daemon: TAs stay up between batches (see engine_begin_batch)
+    int num_shards;            // --shards=DIR[:N],...: courses marked by one TA pool (0 = off)
+    const char *shard_dirs[MAX_SHARDS];
+    int shard_exams[MAX_SHARDS];   // Exams of each course (0: the count passed to engine_submit_exams)
+} run_options_t;
+
+// Snapshot of a running engine, filled by engine_poll
+typedef struct {
+    int batch_id;               // Daemon: batches started so far
+    int total_exams;            // Summed over every course of a sharded engine, like the counts below
+    int exams_completed;        // Every question marked
+    long long questions_marked; // Questions finished (of this batch in a daemon)
+    int active_tas;
+    int rubric_version;         // First course of a sharded engine
+    long long elapsed_ms;
+    int shutdown_requested;
+    int finished;               // Every TA has exited
+} engine_progress_t;
+
+// Exit statuses returned by engine_wait
+#define ENGINE_OK         0
+#define ENGINE_VIOLATION  3     // --chaos: a question was not marked exactly once
+#define ENGINE_HUNG       4     // --watchdog: no progress, the TAs were killed
+#define ENGINE_INTERRUPTED 5    // Drained by a signal or engine_stop before every exam was marked
+
+typedef struct ta_engine ta_engine_t;
+
+// Defaults for every option (num_tas must still be set)
+void engine_defaults(run_options_t *opts);
+
+// Check the options and fill in derived ones (pipeline roles), -1 with a message if invalid
+int engine_check_options(run_options_t *opts);
+
+// Create the semaphores and shared segment and load rubric.txt (per course), NULL on failure
+ta_engine_t *engine_create(const run_options_t *opts);
+
+// Queue exam_0001.txt .. exam_<count>.txt (count <= MAX_EXAMS): reads the manifest, builds
+// the schedule and ingests the exams if configured. Must come before engine_start.
+int engine_submit_exams(ta_engine_t *engine, int count);
+
+// Fork the configured number of TAs, -1 on failure
+int engine_start(ta_engine_t *engine);
+
+// One supervision pass without blocking (dead TAs, rubric edits, autoscaling, watchdog).
+// Returns 1 while TAs are running, 0 once they have all exited.
+int engine_poll(ta_engine_t *engine, engine_progress_t *progress);
+
+// Daemon engines (opts.daemon): the TAs are started without exams and wait for batches.
+// engine_begin_batch resets the exam state, loads <dir>/rubric.txt and exams 1..count from
+// dir, and wakes the pool. Returns the batch number, -1 if the daemon is busy or the batch is
+// invalid. The calling process changes into dir. engine_batch_done is 1 once the batch is
+// fully worked off (keep calling engine_poll meanwhile, it recovers dead TAs).
+int engine_begin_batch(ta_engine_t *engine, const char *dir, int count);
+int engine_batch_done(ta_engine_t *engine);
+
+// Ask the TAs to finish the question in hand and stop
+void engine_stop(ta_engine_t *engine);
+
+// Supervise until every TA has exited; returns ENGINE_OK, ENGINE_VIOLATION, ENGINE_HUNG or
+// ENGINE_INTERRUPTED
+int engine_wait(ta_engine_t *engine);
+
+// Print the run summary and the grade, rubric, shutdown and recovery reports
+void engine_print_report(ta_engine_t *engine);
+
+// Kill any TAs still running and remove the IPC objects
+void engine_destroy(ta_engine_t *engine);
+
+#endif
@@ -0,0 +1,76 @@
+#include <math.h>
+#include <sched.h>
+#include <string.h>
+
+#include "ta_grades.h"
+
+void grades_record(ta_status_t *ta, int question, int mark) {
+    if (question < 0 || question >= RUBRIC_SIZE || mark < 0 || mark > MAX_MARK) {
+        return;
+    }
+    // Seqlock write side: only this TA writes its slot, so a plain increment suffices
+    __atomic_add_fetch(&ta->grades_seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    grade_stats_t *stats = &ta->grades[question];
+    stats->count++;
+    double delta = mark - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (mark - stats->mean);
+    stats->histogram[mark]++;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_add_fetch(&ta->grades_seq, 1, __ATOMIC_RELAXED);
+}
+
+// Chan et al.'s pairwise combination of two Welford accumulators
+static void merge(grade_stats_t *into, const grade_stats_t *from) {
+    if (from->count == 0) {
+        return;
+    }
+    long long count = into->count + from->count;
+    double delta = from->mean - into->mean;
+    into->mean += delta * from->count / count;
+    into->m2 += from->m2 + delta * delta * (double)into->count * from->count / count;
+    into->count = count;
+    for (int mark = 0; mark <= MAX_MARK; mark++) {
+        into->histogram[mark] += from->histogram[mark];
+    }
+}
+
+// An update is a handful of arithmetic operations, so a sequence number that stays odd this
+// long belongs to a TA that died mid-update (until the supervisor resets it)
+#define GRADES_MAX_RETRIES 1000
+
+// Consistent copy of one TA's partials, -1 if it cannot get one (stale partials)
+static int snapshot(const ta_status_t *ta, grade_stats_t copy[RUBRIC_SIZE]) {
+    for (int attempt = 0; attempt < GRADES_MAX_RETRIES; attempt++) {
+        unsigned int before = __atomic_load_n(&ta->grades_seq, __ATOMIC_ACQUIRE);
+        memcpy(copy, ta->grades, sizeof(ta->grades));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        unsigned int after = __atomic_load_n(&ta->grades_seq, __ATOMIC_RELAXED);
+        if (!(before & 1) && before == after) {
+            return 0;
+        }
+        sched_yield();  // Let a preempted writer finish
+    }
+    return -1;
+}
+
+void grades_collect(const shared_data_t *shared_data, grade_stats_t stats[RUBRIC_SIZE]) {
+    memset(stats, 0, sizeof(grade_stats_t) * RUBRIC_SIZE);
+    int num_tas = shared_data->num_tas < MAX_TAS ? shared_data->num_tas : MAX_TAS;
+    for (int i = 0; i < num_tas; i++) {
+        grade_stats_t partial[RUBRIC_SIZE];
+        if (snapshot(&shared_data->tas[i], partial) == -1) {
+            continue;
+        }
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            merge(&stats[q], &partial[q]);
+        }
+    }
+}
+
+double grades_stddev(const grade_stats_t *stats) {
+    return stats->count > 1 ? sqrt(stats->m2 / (stats->count - 1)) : 0.0;
+}
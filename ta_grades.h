@@ -0,0 +1,20 @@
+#ifndef TA_GRADES_H
+#define TA_GRADES_H
+
+#include "ta_shared.h"
+
+// Per-question grade statistics. Each TA accumulates the marks it gives in its own status
+// slot, so the marking path takes no lock; readers merge the per-TA partials on demand.
+
+// Record one mark in the calling TA's own slot
+void grades_record(ta_status_t *ta, int question, int mark);
+
+// Merge every TA's partials into stats[RUBRIC_SIZE]. Lock-free and safe while TAs are
+// marking: each TA's partials are read consistently (retrying around an update in progress).
+// A TA caught mid-update for too long (it died there) is left out.
+void grades_collect(const shared_data_t *shared_data, grade_stats_t stats[RUBRIC_SIZE]);
+
+// Standard deviation of the marks (0 with fewer than two)
+double grades_stddev(const grade_stats_t *stats);
+
+#endif
@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "ta_ingest.h"
+
+// Operations in flight are tagged with the file they belong to and their step
+#define STEP_OPEN  0
+#define STEP_READ  1
+#define STEP_CLOSE 2
+#define MAX_INGEST_DEPTH 256
+
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void exam_filename(char *buffer, size_t size, int exam_index) {
+    snprintf(buffer, size, "exam_%04d.txt", exam_index + 1);
+}
+
+// Question number of a "Q<n>:" section marker line, 0 if the line is not a marker.
+// Parsed by hand because the file contents are not NUL terminated.
+static int parse_section_marker(const char *line, size_t length) {
+    if (length < 3 || line[0] != 'Q') {
+        return 0;
+    }
+    int question = 0;
+    size_t i = 1;
+    while (i < length && line[i] >= '0' && line[i] <= '9' && question < 100000) {
+        question = question * 10 + (line[i] - '0');
+        i++;
+    }
+    return (i > 1 && i < length && line[i] == ':') ? question : 0;
+}
+
+// Record where each "Q<n>:" answer section starts and how long it is.
+// A section runs from the line after its marker to the next marker (or end of file).
+static void index_exam_sections(exam_info_t *exam, const char *data, size_t size, size_t body_start) {
+    for (int i = 0; i < RUBRIC_SIZE; i++) {
+        exam->answer_offset[i] = -1;
+        exam->answer_length[i] = 0;
+    }
+
+    int open_question = -1;
+    size_t pos = body_start;
+    while (pos < size) {
+        const char *line = data + pos;
+        const char *newline = memchr(line, '\n', size - pos);
+        size_t next = newline ? (size_t)(newline - data) + 1 : size;
+
+        int question = parse_section_marker(line, next - pos);
+        if (question > 0) {
+            if (open_question >= 0) {
+                exam->answer_length[open_question] = (long)pos - exam->answer_offset[open_question];
+            }
+            open_question = -1;
+            if (question >= 1 && question <= RUBRIC_SIZE) {
+                open_question = question - 1;
+                exam->answer_offset[open_question] = (long)next;
+            }
+        }
+        pos = next;
+    }
+    if (open_question >= 0) {
+        exam->answer_length[open_question] = (long)size - exam->answer_offset[open_question];
+    }
+}
+
+void exam_parse(exam_info_t *exam, const char *data, size_t size, int exam_index) {
+    // Header line: the student number
+    const char *newline = memchr(data, '\n', size);
+    size_t header_end = newline ? (size_t)(newline - data) : size;
+    size_t header_length = header_end < MAX_LINE_LENGTH - 1 ? header_end : MAX_LINE_LENGTH - 1;
+    memcpy(exam->header, data, header_length);
+    exam->header[header_length] = '\0';
+
+    index_exam_sections(exam, data, size, newline ? header_end + 1 : size);
+
+    exam->exam_index = exam_index;
+    exam->student_id = atoi(exam->header);
+    exam->rubric_version = -1;  // Pinned by whoever loads it for marking
+    exam_filename(exam->file, sizeof(exam->file), exam_index);
+}
+
+// A read that filled the whole buffer may have cut the file short: leave that exam to
+// the on-demand path rather than index a truncated file
+static int accept_read(int exam_index, const char *buffer, long length, exam_info_t *catalog,
+                       int *ready, ingest_report_t *report) {
+    if (length <= 0 || length >= INGEST_BUFFER_SIZE) {
+        return 0;
+    }
+    exam_parse(&catalog[exam_index], buffer, (size_t)length, exam_index);
+    __atomic_store_n(&ready[exam_index], 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&report->bytes, length, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&report->loaded, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// --- io_uring backend (raw syscalls, so the build does not need liburing) ---
+
+typedef struct {
+    int fd;
+    unsigned int entries;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned int pending;       // Queued in the SQ ring, not yet submitted
+} uring_t;
+
+static int uring_open(uring_t *ring, unsigned int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd == -1) {
+        return -1;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        int err = errno;
+        if (ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+        if (ring->cq_ring != MAP_FAILED) munmap(ring->cq_ring, ring->cq_ring_size);
+        if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+        close(ring->fd);
+        errno = err;
+        return -1;
+    }
+
+    char *sq = ring->sq_ring, *cq = ring->cq_ring;
+    ring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void uring_close(uring_t *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Next free submission entry, zeroed (the caller keeps in-flight work under the ring size)
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    unsigned int tail = *ring->sq_tail;
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+    return sqe;
+}
+
+// Submit everything queued and wait for at least one completion
+static int uring_submit_and_wait(uring_t *ring) {
+    int ret;
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (ret == -1 && errno == EINTR);
+    if (ret >= 0) {
+        ring->pending -= (unsigned int)ret < ring->pending ? (unsigned int)ret : ring->pending;
+    }
+    return ret;
+}
+
+typedef struct {
+    int fd;
+    char path[MAX_FILENAME_LENGTH];
+    char *buffer;
+} uring_file_t;
+
+static void prep_step(uring_t *ring, uring_file_t *file, int slot, int step) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    sqe->user_data = ((unsigned long long)slot << 2) | (unsigned long long)step;
+    switch (step) {
+        case STEP_OPEN:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long long)(unsigned long)file->path;
+            sqe->open_flags = O_RDONLY;
+            break;
+        case STEP_READ:
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = file->fd;
+            sqe->addr = (unsigned long long)(unsigned long)file->buffer;
+            sqe->len = INGEST_BUFFER_SIZE;
+            sqe->off = 0;
+            break;
+        default:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = file->fd;
+            break;
+    }
+}
+
+// After a failed submit: reap the requests already submitted, so none is still writing into
+// a buffer when it is freed. Opens that complete here leave their fd in files[] for the
+// caller to close. Returns -1 if the ring cannot be waited on any more.
+static int drain_uring(uring_t *ring, uring_file_t *files, int outstanding) {
+    while (outstanding > 0) {
+        int ret;
+        do {
+            ret = (int)syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        } while (ret == -1 && errno == EINTR);
+        if (ret == -1) {
+            return -1;
+        }
+        unsigned int head = *ring->cq_head;
+        unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            uring_file_t *file = &files[cqe->user_data >> 2];
+            int step = (int)(cqe->user_data & 3);
+            if (step == STEP_OPEN && cqe->res >= 0) {
+                file->fd = cqe->res;
+            }
+            outstanding--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Every file runs open -> read -> close as a chain of completions, with up to depth files
+// in progress at once, so opens of new files overlap reads of earlier ones
+static int ingest_uring(int depth, const int *exam_indices, int count, exam_info_t *catalog,
+                        int *ready, ingest_report_t *report) {
+    uring_t ring;
+    if (uring_open(&ring, (unsigned int)depth) == -1) {
+        snprintf(report->note, sizeof(report->note), "io_uring_setup: %s", strerror(errno));
+        return -1;
+    }
+    if ((int)ring.entries < depth) {
+        depth = (int)ring.entries;
+    }
+
+    uring_file_t *files = calloc((size_t)count, sizeof(uring_file_t));
+    char *buffers = malloc((size_t)depth * INGEST_BUFFER_SIZE);
+    int *free_buffers = malloc((size_t)depth * sizeof(int));
+    if (files == NULL || buffers == NULL || free_buffers == NULL) {
+        snprintf(report->note, sizeof(report->note), "out of memory");
+        free(files);
+        free(buffers);
+        free(free_buffers);
+        uring_close(&ring);
+        return -1;
+    }
+    int num_free = depth;
+    for (int i = 0; i < depth; i++) {
+        free_buffers[i] = i;
+    }
+
+    int next = 0, in_flight = 0, done = 0, failed_setup = 0;
+    long long depth_samples = 0, depth_total = 0;
+    while (done < count) {
+        // Start new files while there are buffers (each file holds one from open to close)
+        while (next < count && num_free > 0) {
+            uring_file_t *file = &files[next];
+            file->buffer = buffers + (size_t)free_buffers[--num_free] * INGEST_BUFFER_SIZE;
+            file->fd = -1;
+            exam_filename(file->path, sizeof(file->path), exam_indices[next]);
+            prep_step(&ring, file, next, STEP_OPEN);
+            in_flight++;
+            next++;
+        }
+        if (in_flight > report->max_in_flight) {
+            report->max_in_flight = in_flight;
+        }
+        depth_total += in_flight;
+        depth_samples++;
+
+        if (uring_submit_and_wait(&ring) == -1) {
+            // EINVAL / EOPNOTSUPP here means an older kernel without these opcodes
+            snprintf(report->note, sizeof(report->note), "io_uring_enter: %s", strerror(errno));
+            failed_setup = 1;
+            break;
+        }
+
+        unsigned int head = *ring.cq_head;
+        unsigned int tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            int slot = (int)(cqe->user_data >> 2);
+            int step = (int)(cqe->user_data & 3);
+            uring_file_t *file = &files[slot];
+            in_flight--;
+
+            if (step == STEP_OPEN && cqe->res >= 0) {
+                file->fd = cqe->res;
+                prep_step(&ring, file, slot, STEP_READ);
+                in_flight++;
+            } else if (step == STEP_READ) {
+                accept_read(exam_indices[slot], file->buffer, cqe->res, catalog, ready, report);
+                prep_step(&ring, file, slot, STEP_CLOSE);
+                file->fd = -1;  // The ring owns the close now
+                in_flight++;
+            } else {
+                // Closed, or the open failed: the file's buffer is free again
+                free_buffers[num_free++] = (int)((file->buffer - buffers) / INGEST_BUFFER_SIZE);
+                done++;
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    report->mean_in_flight = depth_samples ? (double)depth_total / depth_samples : 0.0;
+
+    // Requests queued but never submitted die with the ring; submitted ones are reaped first.
+    // Then close the files left open, and free the paths and buffers only once no request can
+    // use them (if the ring could not be drained they are leaked rather than risk a late access).
+    int drained = failed_setup ? drain_uring(&ring, files, in_flight - (int)ring.pending) == 0 : 1;
+    uring_close(&ring);
+    for (int i = 0; i < next; i++) {
+        if (files[i].fd >= 0) {
+            close(files[i].fd);
+        }
+    }
+    if (drained) {
+        free(files);
+        free(buffers);
+    }
+    free(free_buffers);
+    // A failure before anything completed falls back to threads; later ones leave the
+    // remaining exams to the on-demand path
+    return (failed_setup && report->loaded == 0) ? -1 : 0;
+}
+
+// --- Thread pool fallback: each worker claims the next file and does open/pread/close ---
+
+typedef struct {
+    const int *exam_indices;
+    int count;
+    int next;           // Next file to claim (atomic)
+    int in_flight;      // Workers between open and close (atomic)
+    long long depth_total;  // Sum of in_flight seen at each open (atomic)
+    exam_info_t *catalog;
+    int *ready;
+    ingest_report_t *report;
+} pool_t;
+
+static void *pool_worker(void *arg) {
+    pool_t *pool = arg;
+    char *buffer = malloc(INGEST_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    while (1) {
+        int i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (i >= pool->count) {
+            break;
+        }
+        char path[MAX_FILENAME_LENGTH];
+        exam_filename(path, sizeof(path), pool->exam_indices[i]);
+
+        int depth = __atomic_add_fetch(&pool->in_flight, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&pool->depth_total, depth, __ATOMIC_RELAXED);
+        int seen = __atomic_load_n(&pool->report->max_in_flight, __ATOMIC_RELAXED);
+        while (depth > seen &&
+               !__atomic_compare_exchange_n(&pool->report->max_in_flight, &seen, depth, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+
+        int fd = open(path, O_RDONLY);
+        if (fd != -1) {
+            ssize_t length = pread(fd, buffer, INGEST_BUFFER_SIZE, 0);
+            close(fd);
+            accept_read(pool->exam_indices[i], buffer, (long)length, pool->catalog, pool->ready, pool->report);
+        }
+        __atomic_sub_fetch(&pool->in_flight, 1, __ATOMIC_RELAXED);
+    }
+    free(buffer);
+    return NULL;
+}
+
+static void ingest_threads(int depth, const int *exam_indices, int count, exam_info_t *catalog,
+                           int *ready, ingest_report_t *report) {
+    pool_t pool = { exam_indices, count, 0, 0, 0, catalog, ready, report };
+    int workers = depth < count ? depth : count;
+    pthread_t threads[MAX_INGEST_DEPTH];
+    int started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, pool_worker, &pool) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        pool_worker(&pool);  // No threads at all: do it inline
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    report->mean_in_flight = count > 0 ? (double)pool.depth_total / count : 0.0;
+}
+
+int ingest_exams(ingest_mode_t mode, int depth, const int *exam_indices, int count,
+                 exam_info_t *catalog, int *ready, ingest_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    report->files = count;
+    if (depth < 1) {
+        depth = 1;
+    }
+    if (depth > MAX_INGEST_DEPTH) {
+        depth = MAX_INGEST_DEPTH;
+    }
+
+    long long start = monotonic_us();
+    report->mode = mode;
+    if (mode == INGEST_URING && ingest_uring(depth, exam_indices, count, catalog, ready, report) == -1) {
+        report->mode = INGEST_THREADS;
+        report->max_in_flight = 0;
+    }
+    if (report->mode == INGEST_THREADS) {
+        ingest_threads(depth, exam_indices, count, catalog, ready, report);
+    }
+    report->elapsed_us = monotonic_us() - start;
+    return report->loaded;
+}
+
+const char *ingest_mode_name(ingest_mode_t mode) {
+    switch (mode) {
+        case INGEST_URING:   return "io_uring";
+        case INGEST_THREADS: return "threads";
+        default:             return "off";
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef TA_INGEST_H
+#define TA_INGEST_H
+
+#include "ta_shared.h"
+
+// Exam file parsing and batched ingestion. Ingestion loads the header and answer-section
+// index of many exam files at once, straight into shared memory, instead of one
+// open/map/close round trip per exam when a TA gets to it.
+
+#define INGEST_BUFFER_SIZE 16384    // Larger files are left to the on-demand path
+#define INGEST_DEFAULT_DEPTH 32
+
+typedef enum {
+    INGEST_OFF = 0,     // Read each exam when it is first needed
+    INGEST_URING,       // io_uring: opens, reads and closes submitted in batches
+    INGEST_THREADS      // Thread pool doing open/pread/close (fallback)
+} ingest_mode_t;
+
+typedef struct {
+    ingest_mode_t mode;         // Backend that actually ran
+    int files;                  // Exams requested
+    int loaded;                 // Exams parsed into the catalog
+    int max_in_flight;          // Deepest the I/O queue got
+    double mean_in_flight;      // Average queue depth at each submission
+    long long bytes;
+    long long elapsed_us;
+    char note[160];             // Why io_uring was not used, if it was not
+} ingest_report_t;
+
+// "exam_0001.txt" for exam index 0
+void exam_filename(char *buffer, size_t size, int exam_index);
+
+// Parse an exam file's contents (header line plus "Q<n>:" sections) into exam
+void exam_parse(exam_info_t *exam, const char *data, size_t size, int exam_index);
+
+// Load exam_indices[0..count) into catalog[exam index], setting ready[exam index] for each
+// one parsed. depth bounds the I/O in flight. Falls back from io_uring to threads if the
+// kernel refuses io_uring. Returns the number of exams loaded.
+int ingest_exams(ingest_mode_t mode, int depth, const int *exam_indices, int count,
+                 exam_info_t *catalog, int *ready, ingest_report_t *report);
+
+const char *ingest_mode_name(ingest_mode_t mode);
+
+#endif
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "ta_ipc.h"
+
+// Registry directory, TA_IPC_DIR lets tests and parallel users keep separate registries
+static const char *registry_dir(void) {
+    const char *dir = getenv("TA_IPC_DIR");
+    return (dir != NULL && dir[0] != '\0') ? dir : IPC_REGISTRY_DEFAULT_DIR;
+}
+
+// One entry per segment: run_<pid>.ipc, plus run_<pid>.<shard>.ipc for further courses of a sharded run
+static void registry_path(char *path, size_t size, pid_t pid, int shard) {
+    if (shard > 0) {
+        snprintf(path, size, "%s/run_%d.%d.ipc", registry_dir(), (int)pid, shard);
+    } else {
+        snprintf(path, size, "%s/run_%d.ipc", registry_dir(), (int)pid);
+    }
+}
+
+int ipc_create_semaphores(ipc_run_t *run, int num_sems) {
+    // IPC_PRIVATE always yields a fresh set, so concurrent runs never share state
+    run->semid = semget(IPC_PRIVATE, num_sems, 0600 | IPC_CREAT);
+    if (run->semid == -1) {
+        perror("semget failed");
+        return -1;
+    }
+    return 0;
+}
+
+int ipc_create_segment(ipc_run_t *run, size_t size) {
+    run->shmid = shmget(IPC_PRIVATE, size, 0600 | IPC_CREAT);
+    if (run->shmid == -1) {
+        perror("shmget failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Default huge page size from /proc/meminfo, 0 if the kernel has none
+static size_t huge_page_size(void) {
+    FILE *file = fopen("/proc/meminfo", "r");
+    if (file == NULL) {
+        return 0;
+    }
+    char line[128];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return kb * 1024;
+}
+
+static size_t round_up(size_t size, size_t multiple) {
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+static void append_note(ipc_backing_t *backing, const char *what, int err) {
+    size_t used = strlen(backing->note);
+    snprintf(backing->note + used, sizeof(backing->note) - used, "%s%s: %s",
+             used ? "; " : "", what, strerror(err));
+}
+
+int ipc_create_backed_segment(ipc_run_t *run, size_t size, ipc_backing_t *backing) {
+    backing->hugepages = 0;
+    backing->locked = 0;
+    backing->prefaulted = 0;
+    backing->note[0] = '\0';
+
+    if (backing->want_hugepages) {
+        size_t huge = huge_page_size();
+        if (huge == 0) {
+            append_note(backing, "huge pages", ENOTSUP);
+        } else {
+            // Fails with ENOMEM when the huge page pool (vm.nr_hugepages) is too small
+            size_t rounded = round_up(size, huge);
+            run->shmid = shmget(IPC_PRIVATE, rounded, 0600 | IPC_CREAT | SHM_HUGETLB);
+            if (run->shmid != -1) {
+                backing->hugepages = 1;
+                backing->page_size = huge;
+                backing->size = rounded;
+                return 0;
+            }
+            append_note(backing, "huge pages", errno);
+        }
+    }
+
+    backing->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    backing->size = round_up(size, backing->page_size);
+    return ipc_create_segment(run, backing->size);
+}
+
+void ipc_prepare_segment(void *addr, ipc_backing_t *backing) {
+    if (backing->want_prefault) {
+        // Write every page once so no TA takes a page fault on its first access
+        volatile char *bytes = addr;
+        for (size_t offset = 0; offset < backing->size; offset += backing->page_size) {
+            bytes[offset] = bytes[offset];
+        }
+        backing->prefaulted = 1;
+    }
+
+    if (backing->want_lock) {
+        // The lock is held by the parent, which outlives every TA sharing the pages
+        if (mlock(addr, backing->size) == 0) {
+            backing->locked = 1;
+        } else {
+            append_note(backing, "mlock", errno);
+        }
+    }
+}
+
+void ipc_print_backing(const ipc_backing_t *backing) {
+    printf("Shared segment: %zu KB on %s pages (%zu KB)%s%s\n",
+           backing->size / 1024, backing->hugepages ? "huge" : "regular",
+           backing->page_size / 1024,
+           backing->locked ? ", locked" : "",
+           backing->prefaulted ? ", prefaulted" : "");
+    if (backing->note[0] != '\0') {
+        printf("Shared segment fallback: %s\n", backing->note);
+    }
+}
+
+void ipc_register_run(const ipc_run_t *run) {
+    // Best effort: a missing registry only means the reaper cannot help after a crash
+    if (mkdir(registry_dir(), 01777) == 0) {
+        // mkdir's mode passes through the umask: make the shared directory writable by every user
+        if (chmod(registry_dir(), 01777) == -1) {
+            perror("Failed to open up IPC registry directory");
+        }
+    } else if (errno != EEXIST) {
+        perror("Failed to create IPC registry directory");
+        return;
+    }
+
+    // The directory is shared, so never follow or truncate what is already at the path: drop
+    // our own earlier entry (a run registers again once its segment exists) and create afresh
+    char path[256];
+    registry_path(path, sizeof(path), run->owner_pid, run->shard);
+    unlink(path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "w");
+    if (file == NULL) {
+        perror("Failed to record IPC objects");
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    fprintf(file, "%d %d %d %d\n", (int)run->owner_pid, run->shmid, run->semid, run->shard);
+    fclose(file);
+}
+
+void ipc_unregister_run(const ipc_run_t *run) {
+    char path[256];
+    registry_path(path, sizeof(path), run->owner_pid, run->shard);
+    unlink(path);
+}
+
+void ipc_destroy_run(ipc_run_t *run) {
+    // EINVAL just means the object is already gone (e.g. segment marked for removal)
+    if (run->shmid != -1) {
+        shmctl(run->shmid, IPC_RMID, NULL);
+        run->shmid = -1;
+    }
+    if (run->semid != -1) {
+        semctl(run->semid, 0, IPC_RMID);
+        run->semid = -1;
+    }
+    ipc_unregister_run(run);
+}
+
+// A run is orphaned once its owner no longer exists
+static int owner_alive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+union semun {
+    int val;
+    struct semid_ds *buf;
+    unsigned short *array;
+};
+
+// The registry directory is world writable and PIDs get reused, so an entry may list objects
+// of another user or another run. Objects already gone are dropped from run (set to -1).
+// Returns 0 if what is left was created by this user, and the segment by the recorded owner.
+static int verify_run_objects(ipc_run_t *run) {
+    uid_t uid = geteuid();
+    if (run->shmid != -1) {
+        struct shmid_ds shm;
+        if (shmctl(run->shmid, IPC_STAT, &shm) == -1) {
+            if (errno != EINVAL && errno != EIDRM) {
+                return -1;  // EACCES: someone else's
+            }
+            run->shmid = -1;
+        } else if (shm.shm_perm.cuid != uid || shm.shm_cpid != run->owner_pid) {
+            return -1;
+        }
+    }
+    if (run->semid != -1) {
+        struct semid_ds sem;
+        union semun arg;
+        arg.buf = &sem;
+        if (semctl(run->semid, 0, IPC_STAT, arg) == -1) {
+            if (errno != EINVAL && errno != EIDRM) {
+                return -1;
+            }
+            run->semid = -1;
+        } else if (sem.sem_perm.cuid != uid) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Parse one registry entry, -1 if it is unreadable or truncated
+static int read_registry_entry(const char *path, ipc_run_t *run) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int pid, shmid, semid, shard = 0;
+    int fields = fscanf(file, "%d %d %d %d", &pid, &shmid, &semid, &shard);
+    fclose(file);
+    if (fields < 3) {
+        return -1;  // Entries of older builds have no shard field
+    }
+
+    run->owner_pid = (pid_t)pid;
+    run->shmid = shmid;
+    run->semid = semid;
+    run->shard = shard;
+    return 0;
+}
+
+int ipc_lookup_shard(pid_t pid, int shard, ipc_run_t *run) {
+    if (pid <= 0) {
+        ipc_run_t newest;
+        if (ipc_lookup_run(0, &newest) == -1) {
+            return -1;
+        }
+        pid = newest.owner_pid;
+    }
+    char path[512];
+    registry_path(path, sizeof(path), pid, shard);
+    return read_registry_entry(path, run);
+}
+
+int ipc_lookup_run(pid_t pid, ipc_run_t *run) {
+    char path[512];
+    if (pid > 0) {
+        registry_path(path, sizeof(path), pid, 0);
+        return read_registry_entry(path, run);
+    }
+
+    DIR *dir = opendir(registry_dir());
+    if (dir == NULL) {
+        return -1;
+    }
+
+    // Newest entry by modification time among runs that are still alive
+    int found = -1;
+    time_t newest = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "run_", 4) != 0) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", registry_dir(), entry->d_name);
+        struct stat st;
+        ipc_run_t candidate;
+        if (stat(path, &st) == -1 || read_registry_entry(path, &candidate) == -1) {
+            continue;
+        }
+        if (!owner_alive(candidate.owner_pid) || candidate.shmid == -1 || candidate.shard != 0) {
+            continue;
+        }
+        if (found == -1 || st.st_mtime >= newest) {
+            *run = candidate;
+            newest = st.st_mtime;
+            found = 0;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+int ipc_reap_orphans(void) {
+    DIR *dir = opendir(registry_dir());
+    if (dir == NULL) {
+        return 0;  // Nothing has ever been registered
+    }
+
+    int reaped = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "run_", 4) != 0) {
+            continue;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", registry_dir(), entry->d_name);
+        ipc_run_t run;
+        if (read_registry_entry(path, &run) == -1) {
+            unlink(path);  // Truncated by a crash mid-write, nothing usable left
+            continue;
+        }
+
+        if (owner_alive(run.owner_pid)) {
+            continue;
+        }
+        if (verify_run_objects(&run) == -1) {
+            printf("Skipping %s: its IPC objects belong to another user or process\n", entry->d_name);
+            continue;
+        }
+
+        printf("Reaping run of dead process %d (shmid %d, semid %d)\n",
+               (int)run.owner_pid, run.shmid, run.semid);
+        ipc_destroy_run(&run);
+        reaped++;
+    }
+    closedir(dir);
+    return reaped;
+}
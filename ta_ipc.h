@@ -0,0 +1,62 @@
+#ifndef TA_IPC_H
+#define TA_IPC_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Directory where each run records the IPC objects it owns (override with TA_IPC_DIR)
+#define IPC_REGISTRY_DEFAULT_DIR "/tmp/ta_marking_ipc"
+
+// IPC objects owned by one marking run
+typedef struct {
+    pid_t owner_pid;   // Parent process of the run
+    int shmid;         // Private shared memory segment (-1 if none)
+    int semid;         // Private semaphore set (-1 if none)
+    int shard;         // Course of a sharded run (0: the run's first or only segment)
+} ipc_run_t;
+
+// Create a private (IPC_PRIVATE) semaphore set for this run, -1 on failure
+int ipc_create_semaphores(ipc_run_t *run, int num_sems);
+
+// Create a private (IPC_PRIVATE) shared memory segment for this run, -1 on failure
+int ipc_create_segment(ipc_run_t *run, size_t size);
+
+// Backing of a large shared segment: what was requested and what was actually obtained
+typedef struct {
+    int want_hugepages;    // Try SHM_HUGETLB first
+    int want_lock;         // mlock the segment so it can never be swapped out
+    int want_prefault;     // Touch every page at startup instead of on first use
+    int hugepages;         // Segment ended up on huge pages
+    size_t page_size;      // Page size of the backing
+    size_t size;           // Segment size after rounding to the page size
+    int locked;
+    int prefaulted;
+    char note[160];        // Why a requested feature fell back
+} ipc_backing_t;
+
+// Like ipc_create_segment, but honours the requested backing and falls back to 4K pages
+int ipc_create_backed_segment(ipc_run_t *run, size_t size, ipc_backing_t *backing);
+
+// Pre-fault and/or lock the attached segment as requested (after any NUMA binding)
+void ipc_prepare_segment(void *addr, ipc_backing_t *backing);
+
+// Startup report of the backing that was obtained
+void ipc_print_backing(const ipc_backing_t *backing);
+
+// Record / forget the run in the registry so a reaper can find it after a crash
+void ipc_register_run(const ipc_run_t *run);
+void ipc_unregister_run(const ipc_run_t *run);
+
+// Remove the run's IPC objects and its registry entry
+void ipc_destroy_run(ipc_run_t *run);
+
+// Find a registered run by owner pid (0 picks the most recent live run), -1 if none
+int ipc_lookup_run(pid_t pid, ipc_run_t *run);
+
+// Like ipc_lookup_run, for one course of a sharded run (shard 0 is what ipc_lookup_run finds)
+int ipc_lookup_shard(pid_t pid, int shard, ipc_run_t *run);
+
+// Remove IPC objects of registered runs whose owner process is dead, returns runs reaped
+int ipc_reap_orphans(void);
+
+#endif
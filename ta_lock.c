@@ -0,0 +1,96 @@
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ta_lock.h"
+
+// Spin this many times before sleeping: critical sections are short, sleeping is not
+#define TICKET_SPIN_LIMIT 200
+
+// Shared (not FUTEX_PRIVATE) futex ops: the word lives in a SysV segment mapped by many processes
+static void futex_wait(unsigned int *word, unsigned int expected) {
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+static void futex_wake_all(unsigned int *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+void ticket_lock_init(ticket_lock_t *lock) {
+    __atomic_store_n(&lock->next_ticket, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->now_serving, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->sleepers, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->taker, 0, __ATOMIC_RELEASE);
+}
+
+void ticket_lock_acquire(ticket_lock_t *lock) {
+    ticket_lock_wait(lock, ticket_lock_take(lock, TICKET_ANONYMOUS, NULL, NULL));
+}
+
+unsigned int ticket_lock_take(ticket_lock_t *lock, int taker, unsigned int *ticket, int *has_ticket) {
+    // One taker at a time, so next_ticket only moves once the ticket is published: a plain
+    // fetch-add would leave a window where a killed caller holds a ticket nobody can see
+    int expected = 0;
+    while (!__atomic_compare_exchange_n(&lock->taker, &expected, taker, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        expected = 0;
+        sched_yield();  // The taker may have been preempted between its few stores
+    }
+    unsigned int next = __atomic_load_n(&lock->next_ticket, __ATOMIC_RELAXED);
+    if (ticket != NULL) {
+        *ticket = next;
+        __atomic_store_n(has_ticket, 1, __ATOMIC_SEQ_CST);
+    }
+    __atomic_store_n(&lock->next_ticket, next + 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&lock->taker, 0, __ATOMIC_RELEASE);
+    return next;
+}
+
+void ticket_lock_recover_taker(ticket_lock_t *lock, int taker, const unsigned int *ticket, int *has_ticket) {
+    if (__atomic_load_n(&lock->taker, __ATOMIC_ACQUIRE) != taker) {
+        return;
+    }
+    // Died inside ticket_lock_take: if next_ticket has not moved past the published ticket,
+    // it was never taken
+    if (*has_ticket && __atomic_load_n(&lock->next_ticket, __ATOMIC_ACQUIRE) == *ticket) {
+        *has_ticket = 0;
+    }
+    __atomic_store_n(&lock->taker, 0, __ATOMIC_RELEASE);
+}
+
+void ticket_lock_wait(ticket_lock_t *lock, unsigned int ticket) {
+    for (int spins = 0; ; spins++) {
+        unsigned int serving = __atomic_load_n(&lock->now_serving, __ATOMIC_ACQUIRE);
+        if (serving == ticket) {
+            return;
+        }
+        if (spins < TICKET_SPIN_LIMIT) {
+            sched_yield();  // More TAs than CPUs is normal here, so give the holder the CPU
+            continue;
+        }
+        // The wait only sleeps if now_serving is still the value just read, so a release
+        // between the load and the syscall cannot be missed
+        __atomic_add_fetch(&lock->sleepers, 1, __ATOMIC_SEQ_CST);
+        futex_wait(&lock->now_serving, serving);
+        __atomic_sub_fetch(&lock->sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void ticket_lock_release(ticket_lock_t *lock) {
+    __atomic_add_fetch(&lock->now_serving, 1, __ATOMIC_SEQ_CST);
+    // Every sleeper rechecks its own ticket; only the next one in line proceeds
+    if (__atomic_load_n(&lock->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        futex_wake_all(&lock->now_serving);
+    }
+}
+
+int ticket_lock_abandon(ticket_lock_t *lock, unsigned int ticket) {
+    unsigned int serving = __atomic_load_n(&lock->now_serving, __ATOMIC_ACQUIRE);
+    if (serving == ticket) {
+        ticket_lock_release(lock);
+        return 1;
+    }
+    // Signed distance copes with wrap-around: positive means the ticket was already served
+    return (int)(serving - ticket) > 0;
+}
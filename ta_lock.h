@@ -0,0 +1,40 @@
+#ifndef TA_LOCK_H
+#define TA_LOCK_H
+
+// FIFO ticket lock for data in a shared memory segment, usable across fork()ed processes.
+// Waiters are served strictly in arrival order, unlike a SysV semaphore where any blocked
+// process may win the wakeup race.
+typedef struct {
+    unsigned int next_ticket;   // Ticket handed to the next arriving process
+    unsigned int now_serving;   // Ticket that currently holds the lock (futex word)
+    int sleepers;               // Waiters blocked in the kernel (skip the wake syscall if 0)
+    int taker;                  // Process handing itself the next ticket (0 if none)
+} ticket_lock_t;
+
+// Taker id of a process that is never recovered (the parent)
+#define TICKET_ANONYMOUS -1
+
+// A zero-filled ticket_lock_t is an unlocked lock
+void ticket_lock_init(ticket_lock_t *lock);
+
+void ticket_lock_acquire(ticket_lock_t *lock);
+
+// acquire split in two, so the caller's ticket is published before it blocks. taker is the
+// caller's pid. The ticket is stored in *ticket and *has_ticket set before next_ticket moves
+// past it, so a caller killed at any point leaves either no ticket or a published one.
+// ticket and has_ticket may be NULL for TICKET_ANONYMOUS.
+unsigned int ticket_lock_take(ticket_lock_t *lock, int taker, unsigned int *ticket, int *has_ticket);
+void ticket_lock_wait(ticket_lock_t *lock, unsigned int ticket);
+
+void ticket_lock_release(ticket_lock_t *lock);
+
+// A process that died: undo a take it was in the middle of, leaving *has_ticket set only if
+// the ticket was really taken. Call before ticket_lock_abandon for its ticket.
+void ticket_lock_recover_taker(ticket_lock_t *lock, int taker, const unsigned int *ticket, int *has_ticket);
+
+// Give up the ticket of a process that died. Releases the lock if that ticket holds it,
+// returns 1 once the ticket is dealt with and 0 while it is still queued behind others
+// (call again later: waiting here could deadlock behind another dead process's ticket).
+int ticket_lock_abandon(ticket_lock_t *lock, unsigned int ticket);
+
+#endif
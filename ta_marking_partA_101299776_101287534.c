@@ -10,10 +10,26 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "ta_ipc.h"
+
 #define MAX_EXAMS 100
 #define RUBRIC_SIZE 5
 #define MAX_LINE_LENGTH 100
 
+// --instrument: shadow counters that measure the races below. They are only ever updated
+// with atomic operations on separate fields, so the racy logic itself runs unchanged.
+typedef struct {
+    int marks[MAX_EXAMS][RUBRIC_SIZE];          // Times each question of each exam was marked
+    long long wasted_ms;                        // Marking time spent on duplicate marks
+    int loads[MAX_EXAMS];                       // Times each exam was loaded
+    int index_increments;                       // current_exam_index++ executed
+    char rubric_shadow[RUBRIC_SIZE];            // Last correction of each rubric line (exchanged atomically)
+    int rubric_corrections;
+    int lost_corrections;                       // Corrections based on a value another TA had already replaced
+    int saves_in_flight;
+    int overlapping_saves;                      // save_rubric started while another was writing the file
+} race_stats_t;
+
 // Shared memory structure
 typedef struct {
     char rubric[RUBRIC_SIZE][MAX_LINE_LENGTH];  // Shared rubric data
@@ -23,8 +39,17 @@ typedef struct {
     int exam_finished;                          // Termination flag
     int current_exam_index;                     // Current exam position
     int total_exams;                            // Total exams (20)
+    race_stats_t stats;                         // Only touched with --instrument
 } shared_data_t;
 
+static int instrument = 0;
+
+long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 // Function to load rubric from file to shared memory
 void load_rubric(shared_data_t *shared_data) {
     FILE *file = fopen("rubric.txt", "r");
@@ -39,6 +64,11 @@ void load_rubric(shared_data_t *shared_data) {
         }
         // Remove newline character if present
         shared_data->rubric[i][strcspn(shared_data->rubric[i], "\n")] = 0;
+
+        char *comma_pos = strchr(shared_data->rubric[i], ',');
+        if (comma_pos != NULL && *(comma_pos + 1) != '\0') {
+            shared_data->stats.rubric_shadow[i] = *(comma_pos + 2);
+        }
     }
     fclose(file);
 }
@@ -63,6 +93,9 @@ void load_exam_file(shared_data_t *shared_data, int exam_index) {
     
     // Extract student ID string and convert into integer
     shared_data->current_student_id = atoi(shared_data->current_exam);
+    if (instrument) {
+        __atomic_add_fetch(&shared_data->stats.loads[exam_index], 1, __ATOMIC_RELAXED);
+    }
     
     // Reset questions marked for new exam
     for (int i = 0; i < RUBRIC_SIZE; i++) {
@@ -74,16 +107,24 @@ void load_exam_file(shared_data_t *shared_data, int exam_index) {
 
 // Function to save rubric back to file
 void save_rubric(shared_data_t *shared_data) {
+    race_stats_t *stats = &shared_data->stats;
+    if (instrument && __atomic_add_fetch(&stats->saves_in_flight, 1, __ATOMIC_SEQ_CST) > 1) {
+        __atomic_add_fetch(&stats->overlapping_saves, 1, __ATOMIC_RELAXED);
+    }
+
     FILE *file = fopen("rubric.txt", "w");
     if (file == NULL) {
         perror("Failed to open rubric file for writing");
-        return;
+    } else {
+        for (int i = 0; i < RUBRIC_SIZE; i++) {
+            fprintf(file, "%s\n", shared_data->rubric[i]);
+        }
+        fclose(file);
     }
-    
-    for (int i = 0; i < RUBRIC_SIZE; i++) {
-        fprintf(file, "%s\n", shared_data->rubric[i]);
+
+    if (instrument) {
+        __atomic_sub_fetch(&stats->saves_in_flight, 1, __ATOMIC_SEQ_CST);
     }
-    fclose(file);
 }
 
 // Function to check and potentially correct rubric
@@ -118,6 +159,16 @@ void check_rubric(shared_data_t *shared_data, int ta_id) {
                     new_char = current_char + 1;
                 }
                 *(comma_pos + 2) = new_char;
+
+                // If another TA wrote this line since we read it, one of the two corrections is lost
+                if (instrument) {
+                    race_stats_t *stats = &shared_data->stats;
+                    char previous = __atomic_exchange_n(&stats->rubric_shadow[i], new_char, __ATOMIC_SEQ_CST);
+                    __atomic_add_fetch(&stats->rubric_corrections, 1, __ATOMIC_RELAXED);
+                    if (previous != current_char) {
+                        __atomic_add_fetch(&stats->lost_corrections, 1, __ATOMIC_RELAXED);
+                    }
+                }
                 
                 //printf("TA %d:  Q%d: Thinks for %.1fs → Corrects! %c→%c\n", ta_id, i + 1, think_time, current_char, new_char);
                 printf("TA %d: thinks for %.1fs on Q%d → Needs Correction: %c→%c\n", ta_id, think_time, i+1, current_char, new_char);
@@ -142,12 +193,21 @@ void mark_questions(shared_data_t *shared_data, int ta_id) {
         
         
         if (shared_data->questions_marked[i] == 0) {
+            // Exam this TA believes it is marking (a racy read, like the rest of Part A)
+            int exam_index = shared_data->current_exam_index;
+            long long started = monotonic_ms();
+
             // Mark this question (race condition: multiple TAs might pick same question)
             printf("TA %d: Marking question %d for student %d\n", 
                 ta_id, i + 1, shared_data->current_student_id);
             
             // Marking takes 1.0-2.0 seconds using usleep
             usleep(1000000 + (rand() % 1000001));  // 1,000,000 to 2,000,000 microseconds
+
+            if (instrument && exam_index >= 0 && exam_index < MAX_EXAMS &&
+                __atomic_add_fetch(&shared_data->stats.marks[exam_index][i], 1, __ATOMIC_RELAXED) > 1) {
+                __atomic_add_fetch(&shared_data->stats.wasted_ms, monotonic_ms() - started, __ATOMIC_RELAXED);
+            }
             
             // Mark as completed (race condition: might overwrite other TA's work)
             shared_data->questions_marked[i] = 1;
@@ -202,6 +262,9 @@ void ta_process(shared_data_t *shared_data, int ta_id) {  // Removed unused num_
         
         if (all_questions_marked) {
             // Move to next exam 
+            if (instrument) {
+                __atomic_add_fetch(&shared_data->stats.index_increments, 1, __ATOMIC_RELAXED);
+            }
             shared_data->current_exam_index++;
             if (shared_data->current_exam_index < shared_data->total_exams) {
                 load_exam_file(shared_data, shared_data->current_exam_index);
@@ -217,9 +280,49 @@ void ta_process(shared_data_t *shared_data, int ta_id) {  // Removed unused num_
     }
 }
 
+// --instrument: how often each race happened in this run
+void print_race_report(shared_data_t *shared_data, long long elapsed_ms) {
+    const race_stats_t *stats = &shared_data->stats;
+    int marked = 0, duplicates = 0, skipped = 0, reloaded = 0, incomplete = 0;
+    int last_exam = shared_data->total_exams - 1;  // The 9999 terminator is never marked
+    for (int e = 0; e < last_exam; e++) {
+        int questions = 0;
+        for (int q = 0; q < RUBRIC_SIZE; q++) {
+            marked += stats->marks[e][q];
+            duplicates += stats->marks[e][q] > 1 ? stats->marks[e][q] - 1 : 0;
+            questions += stats->marks[e][q] > 0;
+        }
+        skipped += stats->loads[e] == 0;
+        reloaded += stats->loads[e] > 1;
+        incomplete += stats->loads[e] > 0 && questions < RUBRIC_SIZE;
+    }
+    int advanced = shared_data->current_exam_index;  // Started at 0
+
+    printf("\n===== Race report =====\n");
+    printf("Elapsed: %.1fs   Questions marked: %d (%d unique needed)\n", elapsed_ms / 1000.0, marked,
+           last_exam * RUBRIC_SIZE);
+    printf("Duplicate question marks:     %d (%.1fs of marking wasted)\n", duplicates, stats->wasted_ms / 1000.0);
+    printf("Lost exam index increments:   %d of %d\n", stats->index_increments - advanced, stats->index_increments);
+    printf("Lost rubric corrections:      %d of %d\n", stats->lost_corrections, stats->rubric_corrections);
+    printf("Overlapping rubric saves:     %d\n", stats->overlapping_saves);
+    printf("Skipped exams:                %d (never loaded)\n", skipped);
+    printf("Exams loaded more than once:  %d\n", reloaded);
+    printf("Exams loaded but not fully marked: %d\n", incomplete);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <number_of_TAs>\n", argv[0]);
+    // Remove IPC objects left behind by crashed runs
+    if (argc == 2 && strcmp(argv[1], "--reap") == 0) {
+        int reaped = ipc_reap_orphans();
+        printf("Reaped %d orphaned run(s)\n", reaped);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[2], "--instrument") == 0) {
+        instrument = 1;
+    } else if (argc != 2) {
+        printf("Usage: %s <number_of_TAs> [--instrument]\n", argv[0]);
+        printf("       %s --reap\n", argv[0]);
         exit(1);
     }
     
@@ -232,22 +335,29 @@ int main(int argc, char *argv[]) {
     printf("Starting marking system with %d TAs\n", num_tas);
     printf("NOTE: Race conditions are expected in Part A - this is normal behavior\n");
     
-    // Create shared memory
-    key_t key = 1234;
-    int shmid = shmget(key, sizeof(shared_data_t), 0666 | IPC_CREAT);
-    if (shmid == -1) {
-        perror("shmget failed");
+    // Create private shared memory so concurrent runs never collide
+    ipc_run_t ipc_run = {getpid(), -1, -1, 0};
+    if (ipc_create_segment(&ipc_run, sizeof(shared_data_t)) == -1) {
         exit(1);
     }
+    int shmid = ipc_run.shmid;
+    ipc_register_run(&ipc_run);
     
     // Attach shared memory
     shared_data_t *shared_data = (shared_data_t *)shmat(shmid, (char *)0, 0);
     if (shared_data == (void *)-1) {
         perror("shmat failed");
+        ipc_destroy_run(&ipc_run);
         exit(1);
     }
+
+    // Mark the segment for removal now: it lives until the last TA detaches,
+    // so even a crashed run cannot leak it
+    shmctl(shmid, IPC_RMID, NULL);
     
     // Initialize shared data
+    memset(&shared_data->stats, 0, sizeof(shared_data->stats));
+    long long start_ms = monotonic_ms();
     shared_data->current_exam_index = 0;
     shared_data->total_exams = 20; // We created 20 exam files
     shared_data->exam_finished = 0;
@@ -278,9 +388,13 @@ int main(int argc, char *argv[]) {
         waitpid(pids[i], NULL, 0);
     }
     
-    // Cleanup
+    if (instrument) {
+        print_race_report(shared_data, monotonic_ms() - start_ms);
+    }
+
+    // Cleanup and drop the registry entry
     shmdt(shared_data);
-    shmctl(shmid, IPC_RMID, NULL);
+    ipc_destroy_run(&ipc_run);
     
     printf("All TAs have finished marking. Program completed.\n");
     return 0;
@@ -1,380 +1,367 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/wait.h>
-#include <sys/sem.h>
 #include <string.h>
-#include <time.h>
-
-#define MAX_EXAMS 100
-#define RUBRIC_SIZE 5
-#define MAX_LINE_LENGTH 100
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <getopt.h>
 
-// Semaphore operations
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short *array;
-};
+#include "ta_engine.h"
+#include "ta_daemon.h"
 
-// Semaphore indices
-#define SEM_RUBRIC    0  // Controls rubric modification
-#define SEM_QUESTIONS 1  // Controls question marking 
-#define SEM_SHARED    2 // Controls general shared data access
-#define NUM_SEMAPHORES 3
+// Command line front end of the marking engine (see ta_engine.h)
 
-// Shared memory structure
-typedef struct {
-    char rubric[RUBRIC_SIZE][MAX_LINE_LENGTH];  // Shared rubric data
-    char current_exam[MAX_LINE_LENGTH];         // Current exam content
-    int current_student_id;                     // Current student number
-    int questions_marked[RUBRIC_SIZE];          // Marking status (0 for non marked and available / 1 for marked and should not be )
-    int exams_finished;                          // Termination flag that all exams have been completed
-    int current_exam_index;                     // Current exam position
-    int total_exams;                            // Total exams (20)
-} shared_data_t;
+#define DEFAULT_EXAMS 20
 
-// Semaphore operations
-void sem_wait(int semid, int sem_num) {
-    struct sembuf sb = {sem_num, -1, 0};
-    semop(semid, &sb, 1);
-}
+static int num_exams = DEFAULT_EXAMS;           // --exams=N
+static const char *daemon_socket = NULL;        // --daemon=SOCKET
+static const char *submit_socket = NULL;        // --submit=SOCKET DIR
+static const char *control_socket = NULL;       // --control=SOCKET status|stop
+static const char *client_argument = NULL;      // DIR or the control command
 
-void sem_signal(int semid, int sem_num) {
-    struct sembuf sb = {sem_num, 1, 0};
-    semop(semid, &sb, 1);
-}
-
-// Function to load rubric from file to shared memory
-void load_rubric(shared_data_t *shared_data) {
-    FILE *file = fopen("rubric.txt", "r");
-    if (file == NULL) {
-        perror("Failed to open rubric file");
-        exit(1);
-    }
-    
-    for (int i = 0; i < RUBRIC_SIZE; i++) {
-        if (fgets(shared_data->rubric[i], MAX_LINE_LENGTH, file) == NULL) {
-            break;
-        }
-        shared_data->rubric[i][strcspn(shared_data->rubric[i], "\n")] = 0;
-    }
-    fclose(file);
+void print_usage(const char *prog) {
+    printf("Usage: %s <number_of_TAs> [options]\n", prog);
+    printf("       %s --reap\n", prog);
+    printf("       %s --submit=SOCKET [--exams=N] DIR\n", prog);
+    printf("       %s --control=SOCKET status|stop\n", prog);
+    printf("Options:\n");
+    printf("  --pin=compact|scatter|CPULIST  Pin TAs to CPUs (e.g. --pin=0,2,4-7)\n");
+    printf("  --numa-node=N                  Place the shared segment on NUMA node N\n");
+    printf("  --hugepages                    Back the shared segment with huge pages\n");
+    printf("  --mlock                        Lock the shared segment in memory\n");
+    printf("  --prefault                     Fault in the whole segment at startup\n");
+    printf("  --pipeline[=auto|L:R:M]        Dedicated roles: L loaders, R rubric reviewers, M markers\n");
+    printf("  --autoscale=MIN:MAX            Grow/shrink the TA pool with the backlog\n");
+    printf("  --teams=SIZE                   TA teams with their own lock and queue, fed in batches\n");
+    printf("  --time-scale=F                 Multiply every simulated delay by F (e.g. 0.1 for benchmarks)\n");
+    printf("  --ingest=uring|threads         Load all exams in one batch at startup (io_uring or pread threads)\n");
+    printf("  --ingest-depth=N               I/O requests in flight while ingesting (default %d)\n", INGEST_DEFAULT_DEPTH);
+    printf("  --chaos=SEED                   Stress test: seeded random yields/delays at every lock operation,\n");
+    printf("                                 then check every question was marked exactly once (exit 3 if not)\n");
+    printf("  --watchdog=SECONDS             Abort with exit 4 if no progress is made for SECONDS\n");
+    printf("  --respawn                      Replace TAs that die mid-run (up to %d times each)\n", MAX_RESPAWNS);
+    printf("  --lock=sysv|ticket             Shared-state lock: SysV semaphore (default) or FIFO ticket lock\n");
+    printf("  --report-json=FILE             Append a JSON run report (latency percentiles)\n");
+    printf("  --results=FILE                 Append every mark with its feedback\n");
+    printf("  --speed-aware                  Steer the last questions of an exam to faster TAs\n");
+    printf("  --speculate                    Re-mark straggling questions (pipeline mode)\n");
+    printf("  --manifest=FILE                Exam priorities and deadlines (\"<exam> <priority> [deadline_s]\")\n");
+    printf("  --exams=N                      Mark exam_0001.txt .. exam_N.txt (default %d, at most %d)\n",
+           DEFAULT_EXAMS, MAX_EXAMS);
+    printf("  --daemon=SOCKET                Keep the TAs up and take batches on a Unix socket\n");
+    printf("  --shards=DIR[:N],DIR[:N],...   Mark several courses with one TA pool (N exams each, default --exams)\n");
 }
 
-// Function to load exam file - IMPROVED
-void load_exam_file(shared_data_t *shared_data, int exam_index) {
-    // Note: Caller should hold SEM_SHARED lock when calling this function!
-    
-    char filename[25];
-    snprintf(filename, sizeof(filename), "exam_%04d.txt", exam_index + 1);
-    
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Failed to open exam file");
-        return;
-    }
-    
-    if (fgets(shared_data->current_exam, MAX_LINE_LENGTH, file) == NULL) {
-        perror("Failed to read exam file");
-        fclose(file);
-        return;
-    }
-    fclose(file);
-    
-    shared_data->current_student_id = atoi(shared_data->current_exam);
-    
-    // Reset questions marked for new exam
-    for (int i = 0; i < RUBRIC_SIZE; i++) {
-        shared_data->questions_marked[i] = 0;
+// A whole decimal number in [min, max], -1 if text is anything else (atoi would take
+// "abc" as 0 and "4x" as 4)
+static int parse_int(const char *text, long min, long max, int *value) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < min || parsed > max) {
+        return -1;
     }
-    
-    printf("\nTA loaded exam: %s (Student ID: %d)\n\n", filename, shared_data->current_student_id);
+    *value = (int)parsed;
+    return 0;
 }
 
-// Function to save rubric back to file
-void save_rubric(shared_data_t *shared_data, int semid) {
-    sem_wait(semid, SEM_RUBRIC);  // Only one TA modifies rubric file
-    
-    FILE *file = fopen("rubric.txt", "w");
-    if (file == NULL) {
-        perror("Failed to open rubric file for writing");
-        sem_signal(semid, SEM_RUBRIC);
-        return;
+// --chaos=SEED: an unsigned decimal (strtoul alone wraps "-5" around)
+static int parse_seed(const char *text, unsigned int *seed) {
+    char *end;
+    errno = 0;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (!isdigit((unsigned char)text[0]) || *end != '\0' || errno == ERANGE || parsed > UINT_MAX) {
+        return -1;
     }
-    
-    for (int i = 0; i < RUBRIC_SIZE; i++) {
-        fprintf(file, "%s\n", shared_data->rubric[i]);
-    }
-    fclose(file);
-    
-    sem_signal(semid, SEM_RUBRIC);
+    *seed = (unsigned int)parsed;
+    return 0;
 }
 
-// Function to check and potentially correct rubric
-void check_rubric(shared_data_t *shared_data, int ta_id, int semid) {
-    printf("TA %d: Checking rubric...\n", ta_id);
-    
-    for (int i = 0; i < RUBRIC_SIZE; i++) {
-        // Random delay between 0.5-1.0 seconds using sleep
-        double delay_seconds = 0.5 + (rand() % 501) / 1000.0;  // 0.5 to 1.0 seconds
-        sleep(delay_seconds);  // Use sleep instead of usleep
-
-        // Calculate thinking time in seconds for output (already have it!)
-        double think_time = delay_seconds;
-        
-        // Random decision to correct (30% chance fixed)
-        int should_correct = (rand() % 100 < 30);
-        
-        if (should_correct) {
-            sem_wait(semid, SEM_QUESTIONS);  // Lock rubric for modification
-            
-            char *comma_pos = strchr(shared_data->rubric[i], ',');
-            if (comma_pos != NULL && *(comma_pos + 2) != '\0') {
-                char current_char = *(comma_pos + 2);
-                
-                char new_char;
-                if (current_char >= 'A' && current_char <= 'Z') {
-                    new_char = 'A' + ((current_char - 'A' + 1) % 26);
-                } else {
-                    new_char = current_char + 1;
-                }
-                *(comma_pos + 2) = new_char;
-                
-                printf("TA %d: thinks for %.1fs on Q%d → Corrects: %c→%c\n", 
-                       ta_id, think_time, i+1, current_char, new_char);
-
-                save_rubric(shared_data, semid);
-            }
-            
-            sem_signal(semid, SEM_QUESTIONS);  // Release rubric lock
-        } else {
-            printf("TA %d: thinks for %.1fs on Q%d → No Correction Needed\n", 
-                   ta_id, think_time, i+1);
+// --shards=DIR[:N],...: split in place (argv strings are writable), -1 if malformed
+static int parse_shards(run_options_t *opts, char *list) {
+    for (char *save = NULL, *dir = strtok_r(list, ",", &save); dir != NULL; dir = strtok_r(NULL, ",", &save)) {
+        if (opts->num_shards == MAX_SHARDS) {
+            printf("--shards takes at most %d courses\n", MAX_SHARDS);
+            return -1;
         }
-    }
-}
-
-// Function to mark questions with synchronization 
-void mark_questions(shared_data_t *shared_data, int ta_id, int semid) {
-    
-    // CAPTURE student ID at start
-    sem_wait(semid, SEM_SHARED);
-    int captured_student_id = shared_data->current_student_id;  // Save it!
-    sem_signal(semid, SEM_SHARED);
-
-    printf("TA %d: Starting to mark exam for student %d\n", ta_id, captured_student_id);
-    
-    int marked_any = 0;
-    
-    for (int attempt = 0; attempt < RUBRIC_SIZE; attempt++) {  // Limit attempts to prevent infinite loop
-        sem_wait(semid, SEM_SHARED);
-        
-        // Find an unmarked question
-        int question_to_mark = -1;
-        for (int i = 0; i < RUBRIC_SIZE; i++) {
-            if (shared_data->questions_marked[i] == 0) {
-                question_to_mark = i;
-                shared_data->questions_marked[i] = 1;  // Mark as in progress
-                marked_any = 1;
-                break;
+        int exams = 0;
+        char *colon = strrchr(dir, ':');
+        if (colon != NULL && colon[1] != '\0' && strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+            int valid = parse_int(colon + 1, 1, MAX_EXAMS, &exams) == 0;
+            *colon = '\0';
+            if (!valid) {
+                printf("Invalid exam count for course %s (1 to %d)\n", dir, MAX_EXAMS);
+                return -1;
             }
         }
-        
-        sem_signal(semid, SEM_SHARED);
-        
-        if (question_to_mark == -1) {
-            // No more questions to mark
-            if (!marked_any) {
-                printf("TA %d: No questions available to mark for student %d\n", 
-                       ta_id, captured_student_id);
-            }
-            break;
-        }
-        
-        // Mark the question
-        printf("TA %d: Marking question %d for student %d\n", 
-               ta_id, question_to_mark + 1, captured_student_id);  // Use captured ID
-        
-        //usleep(1000000 + (rand() % 1000001));  // 1.0-2.0 seconds for marking
-        sleep(1 + rand() % 2);
-        
-        printf("TA %d: Finished marking question %d for student %d\n", 
-               ta_id, question_to_mark + 1, captured_student_id);  // Use captured ID
-        
-        usleep(100000);  // Small delay
-    }
-    
-    if (marked_any) {
-        printf("TA %d: Completed marking questions for student %d\n", ta_id, captured_student_id);
+        opts->shard_dirs[opts->num_shards] = dir;
+        opts->shard_exams[opts->num_shards] = exams;
+        opts->num_shards++;
     }
+    return opts->num_shards > 0 ? 0 : -1;
 }
 
-// TA process function - PROPERLY FIXED
-void ta_process(shared_data_t *shared_data, int ta_id, int semid) {
-    srand(time(NULL) + ta_id);
-    
-    while (1) {       
-        // Brief check for termination
-        sem_wait(semid, SEM_SHARED);
-        if (shared_data->exams_finished) {
-            sem_signal(semid, SEM_SHARED);
-            printf("TA %d: Exiting - all exams completed\n", ta_id);
-            break;
-        }
-        sem_signal(semid, SEM_SHARED);
-
-        
-        // Check if we need to load next exam if all questions have been marked
-        // Ensures TAs arent loading next exam txt file at the same time and corrupting it
-        sem_wait(semid, SEM_SHARED);
-
-        // Before even performing any activities on the exam, check if we need have reached
-        if (shared_data->current_student_id == 9999) {
-            shared_data->exams_finished = 1;  // Exam marking as concluded
-            printf("TA %d: Found termination exam (9999)\n", ta_id);
-            sem_signal(semid, SEM_SHARED);
-            break;
-        }
+// Parse the command line into opts, exits on invalid input
+void parse_options(int argc, char *argv[], run_options_t *opts) {
+    engine_defaults(opts);
 
-        // Re-check termination inside critical section if break fails?
-        if (shared_data->exams_finished) {
-            sem_signal(semid, SEM_SHARED);
-            break;
-        }
+    static const struct option long_options[] = {
+        {"reap",      no_argument,       NULL, 'r'},
+        {"exams",     required_argument, NULL, 'E'},
+        {"daemon",    required_argument, NULL, 'd'},
+        {"submit",    required_argument, NULL, 'U'},
+        {"control",   required_argument, NULL, 'O'},
+        {"pin",       required_argument, NULL, 'p'},
+        {"numa-node", required_argument, NULL, 'n'},
+        {"hugepages", no_argument,       NULL, 'H'},
+        {"mlock",     no_argument,       NULL, 'L'},
+        {"prefault",  no_argument,       NULL, 'F'},
+        {"pipeline",  optional_argument, NULL, 'P'},
+        {"autoscale", required_argument, NULL, 'A'},
+        {"manifest",  required_argument, NULL, 'M'},
+        {"speed-aware", no_argument,     NULL, 'S'},
+        {"report-json", required_argument, NULL, 'J'},
+        {"results",   required_argument, NULL, 'Q'},
+        {"speculate", no_argument,       NULL, 'X'},
+        {"lock",      required_argument, NULL, 'K'},
+        {"respawn",   no_argument,       NULL, 'R'},
+        {"chaos",     required_argument, NULL, 'C'},
+        {"watchdog",  required_argument, NULL, 'W'},
+        {"teams",     required_argument, NULL, 'T'},
+        {"time-scale", required_argument, NULL, 'Z'},
+        {"ingest",    required_argument, NULL, 'I'},
+        {"ingest-depth", required_argument, NULL, 'D'},
+        {"shards",    required_argument, NULL, 'B'},
+        {NULL, 0, NULL, 0}
+    };
 
-       // Check if current exam still needs questions to be marked
-        int all_questions_marked = 1;
-        for (int i = 0; i < RUBRIC_SIZE; i++) {
-            if (shared_data->questions_marked[i] == 0) {
-                all_questions_marked = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r':
+                opts->reap = 1;
                 break;
-            }
-        }
-
-        // If all questions answered, check if we move to the next exam or break since we are finished
-        if (all_questions_marked) {
-            // Move to next exam 
-            shared_data->current_exam_index++;
-            if (shared_data->current_exam_index < shared_data->total_exams) {
-                load_exam_file(shared_data, shared_data->current_exam_index);
-                sem_signal(semid, SEM_SHARED);
-                continue;
-            } else {
-                shared_data->exams_finished = 1;
-                printf("TA %d: No more exams to mark\n", ta_id);
-                sem_signal(semid, SEM_SHARED);
+            case 'E':
+                if (parse_int(optarg, 1, MAX_EXAMS, &num_exams) == -1) {
+                    printf("Invalid --exams value: %s (1 to %d)\n", optarg, MAX_EXAMS);
+                    exit(1);
+                }
                 break;
-            }
-        }
-        sem_signal(semid, SEM_SHARED); // release lock for actual work
-
-        // Check conditions AFTER releasing lock
-        if (shared_data->exams_finished || shared_data->current_student_id == 9999) {
-            break;
+            case 'd':
+                daemon_socket = optarg;
+                opts->daemon = 1;
+                break;
+            case 'U':
+                submit_socket = optarg;
+                break;
+            case 'B':
+                if (parse_shards(opts, optarg) == -1) {
+                    printf("Invalid --shards value (expected DIR[:EXAMS],DIR[:EXAMS],...)\n");
+                    exit(1);
+                }
+                break;
+            case 'O':
+                control_socket = optarg;
+                break;
+            case 'p':
+                if (placement_parse(&opts->placement, optarg) == -1) {
+                    printf("Invalid --pin value: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'n':
+                if (parse_int(optarg, 0, INT_MAX, &opts->placement.numa_node) == -1 ||
+                    !placement_node_online(opts->placement.numa_node)) {
+                    printf("Invalid --numa-node value: %s (not an online NUMA node)\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'H':
+                opts->backing.want_hugepages = 1;
+                break;
+            case 'L':
+                opts->backing.want_lock = 1;
+                break;
+            case 'F':
+                opts->backing.want_prefault = 1;
+                break;
+            case 'P':
+                opts->pipeline = 1;
+                if (optarg != NULL && strcmp(optarg, "auto") != 0) {
+                    if (sscanf(optarg, "%d:%d:%d", &opts->num_loaders, &opts->num_reviewers,
+                               &opts->num_markers) != 3) {
+                        printf("Invalid --pipeline value: %s\n", optarg);
+                        exit(1);
+                    }
+                }
+                break;
+            case 'M':
+                opts->manifest = optarg;
+                break;
+            case 'S':
+                opts->speed_aware = 1;
+                break;
+            case 'J':
+                opts->report_json = optarg;
+                break;
+            case 'Q':
+                opts->results = optarg;
+                break;
+            case 'C':
+                opts->chaos = 1;
+                if (parse_seed(optarg, &opts->chaos_seed) == -1) {
+                    printf("Invalid --chaos value: %s (0 to %u)\n", optarg, UINT_MAX);
+                    exit(1);
+                }
+                break;
+            case 'W':
+                if (parse_int(optarg, 1, INT_MAX, &opts->watchdog_s) == -1) {
+                    printf("Invalid --watchdog value: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'R':
+                opts->respawn = 1;
+                break;
+            case 'T':
+                if (parse_int(optarg, 1, MAX_TAS, &opts->team_size) == -1) {
+                    printf("Invalid --teams value: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'Z':
+                char *end;
+                opts->time_scale = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(opts->time_scale > 0)) {
+                    printf("Invalid --time-scale value: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'I':
+                if (strcmp(optarg, "uring") == 0) {
+                    opts->ingest = INGEST_URING;
+                } else if (strcmp(optarg, "threads") == 0) {
+                    opts->ingest = INGEST_THREADS;
+                } else {
+                    printf("Invalid --ingest value: %s (uring or threads)\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'D':
+                if (parse_int(optarg, 1, INT_MAX, &opts->ingest_depth) == -1) {
+                    printf("Invalid --ingest-depth value: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'K':
+                if (strcmp(optarg, "sysv") == 0) {
+                    opts->lock_mode = LOCK_SYSV;
+                } else if (strcmp(optarg, "ticket") == 0) {
+                    opts->lock_mode = LOCK_TICKET;
+                } else {
+                    printf("Invalid --lock value: %s (sysv or ticket)\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'X':
+                opts->speculate = 1;
+                opts->speed_aware = 1;  // Speculation relies on the same speed estimates
+                break;
+            case 'A':
+                opts->autoscale = 1;
+                if (sscanf(optarg, "%d:%d", &opts->min_tas, &opts->max_tas) != 2 ||
+                    opts->min_tas < 2 || opts->max_tas < opts->min_tas || opts->max_tas > MAX_TAS) {
+                    printf("Invalid --autoscale value: %s (need 2 <= MIN <= MAX <= %d)\n", optarg, MAX_TAS);
+                    exit(1);
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
         }
+    }
 
+    if (opts->reap) {
+        return;
+    }
 
-        // Check rubric
-        check_rubric(shared_data, ta_id, semid);
-            
-        // Mark questions
-        mark_questions(shared_data, ta_id, semid);
-        
-        // Small delay to prevent tight loop
-        usleep(100000);  // 0.1 seconds
-    }   
-}        
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    if (submit_socket != NULL || control_socket != NULL) {
+        client_argument = argv[optind];
+        return;
+    }
 
+    if (parse_int(argv[optind], INT_MIN, INT_MAX, &opts->num_tas) == -1) {
+        printf("Invalid number of TAs: %s\n", argv[optind]);
+        exit(1);
+    }
+    opts->handle_signals = 1;
+    if (engine_check_options(opts) == -1) {
+        exit(1);
+    }
+}
 
+int main(int argc, char *argv[]) {
+    run_options_t opts;
+    parse_options(argc, argv, &opts);
 
+    // Remove IPC objects left behind by crashed runs
+    if (opts.reap) {
+        int reaped = ipc_reap_orphans();
+        printf("Reaped %d orphaned run(s)\n", reaped);
+        return 0;
+    }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <number_of_TAs>\n", argv[0]);
-        exit(1);
+    // Clients of a running daemon
+    if (submit_socket != NULL) {
+        return daemon_submit(submit_socket, client_argument, num_exams) == 0 ? 0 : 1;
     }
-    
-    int num_tas = atoi(argv[1]);
-    if (num_tas < 2) {
-        printf("Number of TAs must be at least 2\n");
-        exit(1);
+    if (control_socket != NULL) {
+        if (strcmp(client_argument, "status") != 0 && strcmp(client_argument, "stop") != 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return daemon_control(control_socket, strcmp(client_argument, "stop") == 0 ? "STOP" : "STATUS") == 0 ? 0 : 1;
     }
-    
-    printf("Starting synchronized marking system with %d TAs\n", num_tas);
-    
-    // Create semaphores
-    key_t sem_key = 1235;
-    int semid = semget(sem_key, NUM_SEMAPHORES, 0666 | IPC_CREAT);
-    if (semid == -1) {
-        perror("semget failed");
-        exit(1);
+
+    printf("Starting synchronized marking system with %d TAs\n", opts.num_tas);
+    if (opts.chaos) {
+        printf("Chaos mode: seed %u (replay with --chaos=%u)\n", opts.chaos_seed, opts.chaos_seed);
     }
-    
-    // Initialize semaphores
-    union semun arg;
-    unsigned short values[NUM_SEMAPHORES] = {1, 1, 1};  // All binary semaphores
-    arg.array = values;
-    if (semctl(semid, 0, SETALL, arg) == -1) {
-        perror("semctl SETALL failed");
+
+    ta_engine_t *engine = engine_create(&opts);
+    if (engine == NULL) {
         exit(1);
     }
-    
-    // Create shared memory
-    key_t shm_key = 1234;
-    int shmid = shmget(shm_key, sizeof(shared_data_t), 0666 | IPC_CREAT);
-    if (shmid == -1) {
-        perror("shmget failed");
-        exit(1);
+    if (opts.daemon) {
+        // Batches come over the socket; the TAs stay up until a STOP request or a signal
+        int result = engine_start(engine) == 0 ? daemon_serve(engine, daemon_socket) : -1;
+        if (result == 0) {
+            engine_wait(engine);
+            engine_print_report(engine);
+        }
+        engine_destroy(engine);
+        return result == 0 ? 0 : 1;
     }
-    
-    // Attach shared memory
-    shared_data_t *shared_data = (shared_data_t *)shmat(shmid, (char *)0, 0);
-    if (shared_data == (void *)-1) {
-        perror("shmat failed");
+    if (engine_submit_exams(engine, num_exams) == -1 || engine_start(engine) == -1) {
+        engine_destroy(engine);
         exit(1);
     }
-    
-    // Initialize shared data
-    shared_data->current_exam_index = 0;
-    shared_data->total_exams = 20;
-    shared_data->exams_finished = 0;
-    
-    // Load initial rubric and exam
-    load_rubric(shared_data);
-    load_exam_file(shared_data, 0);
-    
-    // Create TA processes
-    pid_t pids[num_tas];
-    
-    for (int i = 0; i < num_tas; i++) {
-        pids[i] = fork();
-        
-        if (pids[i] == 0) {
-            // Child process (TA)
-            ta_process(shared_data, i + 1, semid);
-            shmdt(shared_data);
-            exit(0);
-        } else if (pids[i] < 0) {
-            perror("fork failed");
-            exit(1);
-        }
+
+    int status = engine_wait(engine);
+    if (status != ENGINE_HUNG) {
+        engine_print_report(engine);
     }
-    
-    // Parent process waits for all TAs to finish
-    for (int i = 0; i < num_tas; i++) {
-        waitpid(pids[i], NULL, 0);
+    engine_destroy(engine);
+
+    if (status == ENGINE_OK) {
+        printf("All TAs have finished marking. Program completed.\n");
+    } else if (status == ENGINE_INTERRUPTED) {
+        printf("Run drained before every exam was marked (see the shutdown report).\n");
     }
-    
-    // Cleanup
-    shmdt(shared_data);
-    shmctl(shmid, IPC_RMID, NULL);
-    
-    // Remove semaphores
-    semctl(semid, 0, IPC_RMID);
-    
-    printf("All TAs have finished marking. Program completed.\n");
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
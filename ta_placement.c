@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "ta_placement.h"
+
+// Read a small integer from a sysfs topology file, -1 if unavailable
+static int read_topology_value(int cpu, const char *name) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int value = -1;
+    if (fscanf(file, "%d", &value) != 1) {
+        value = -1;
+    }
+    fclose(file);
+    return value;
+}
+
+int placement_cpu_socket(int cpu) {
+    return read_topology_value(cpu, "physical_package_id");
+}
+
+typedef struct {
+    int cpu;
+    int socket;
+    int core;
+} cpu_info_t;
+
+static int compare_compact(const void *a, const void *b) {
+    const cpu_info_t *x = a, *y = b;
+    if (x->socket != y->socket) return x->socket - y->socket;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+// CPUs this process may run on, in ascending order
+static int allowed_cpus(cpu_info_t *cpus) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        return 0;
+    }
+    int count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < MAX_PLACEMENT_CPUS; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus[count].cpu = cpu;
+            cpus[count].socket = placement_cpu_socket(cpu);
+            cpus[count].core = read_topology_value(cpu, "core_id");
+            count++;
+        }
+    }
+    return count;
+}
+
+// Parse "0,2,4-7" into placement->cpus
+static int parse_cpu_list(placement_t *placement, const char *spec) {
+    const char *p = spec;
+    placement->num_cpus = 0;
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (placement->num_cpus == MAX_PLACEMENT_CPUS) {
+                return -1;
+            }
+            placement->cpus[placement->num_cpus++] = (int)cpu;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return -1;
+        }
+    }
+    return placement->num_cpus > 0 ? 0 : -1;
+}
+
+int placement_parse(placement_t *placement, const char *spec) {
+    if (strcmp(spec, "none") == 0) {
+        placement->mode = PIN_NONE;
+        placement->num_cpus = 0;
+        return 0;
+    }
+    if (strcmp(spec, "compact") != 0 && strcmp(spec, "scatter") != 0) {
+        placement->mode = PIN_LIST;
+        return parse_cpu_list(placement, spec);
+    }
+
+    cpu_info_t cpus[MAX_PLACEMENT_CPUS];
+    int count = allowed_cpus(cpus);
+    if (count == 0) {
+        return -1;
+    }
+    qsort(cpus, count, sizeof(cpu_info_t), compare_compact);
+
+    placement->num_cpus = 0;
+    if (strcmp(spec, "compact") == 0) {
+        // Neighbouring TAs share a socket (and its caches) for as long as possible
+        placement->mode = PIN_COMPACT;
+        for (int i = 0; i < count; i++) {
+            placement->cpus[placement->num_cpus++] = cpus[i].cpu;
+        }
+        return 0;
+    }
+
+    // Scatter: cpus[] is grouped by socket, so deal one CPU from each group per round
+    placement->mode = PIN_SCATTER;
+    int group_start[MAX_PLACEMENT_CPUS];
+    int num_groups = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || cpus[i].socket != cpus[i - 1].socket) {
+            group_start[num_groups++] = i;
+        }
+    }
+    for (int round = 0; placement->num_cpus < count; round++) {
+        for (int g = 0; g < num_groups; g++) {
+            int group_end = (g + 1 < num_groups) ? group_start[g + 1] : count;
+            if (group_start[g] + round < group_end) {
+                placement->cpus[placement->num_cpus++] = cpus[group_start[g] + round].cpu;
+            }
+        }
+    }
+    return 0;
+}
+
+int placement_cpu_for_ta(const placement_t *placement, int ta_index) {
+    if (placement->mode == PIN_NONE || placement->num_cpus == 0) {
+        return -1;
+    }
+    // More TAs than CPUs wrap around in the same order
+    return placement->cpus[ta_index % placement->num_cpus];
+}
+
+int placement_pin_self(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+int placement_node_online(int node) {
+    if (node < 0) {
+        return 0;
+    }
+    if (access("/sys/devices/system/node", F_OK) == -1) {
+        return node == 0;
+    }
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+    return access(path, F_OK) == 0;
+}
+
+int placement_bind_memory(void *addr, size_t length, int node) {
+    if (node < 0 || node >= (int)(8 * sizeof(unsigned long)) - 1) {
+        return -1;
+    }
+    // Raw syscall so the build does not need libnuma
+    unsigned long nodemask = 1UL << node;
+    return (int)syscall(SYS_mbind, addr, length, MPOL_BIND, &nodemask,
+                        8 * sizeof(nodemask), MPOL_MF_MOVE);
+}
+
+int placement_memory_node(void *addr) {
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) == -1) {
+        return -1;
+    }
+    return node;
+}
+
+const char *placement_mode_name(pin_mode_t mode) {
+    switch (mode) {
+        case PIN_COMPACT: return "compact";
+        case PIN_SCATTER: return "scatter";
+        case PIN_LIST:    return "cpu list";
+        default:          return "none";
+    }
+}
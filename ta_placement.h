@@ -0,0 +1,46 @@
+#ifndef TA_PLACEMENT_H
+#define TA_PLACEMENT_H
+
+#include <stddef.h>
+
+#define MAX_PLACEMENT_CPUS 1024
+
+// How TA processes are pinned to CPUs
+typedef enum {
+    PIN_NONE = 0,   // Leave placement to the scheduler
+    PIN_COMPACT,    // Fill one socket's cores before moving to the next
+    PIN_SCATTER,    // Round-robin TAs across sockets
+    PIN_LIST        // Explicit CPU list, e.g. "0,2,4-7"
+} pin_mode_t;
+
+typedef struct {
+    pin_mode_t mode;
+    int num_cpus;                      // Entries in cpus[] (placement order)
+    int cpus[MAX_PLACEMENT_CPUS];
+    int numa_node;                     // Node for the shared segment (-1 = default policy)
+} placement_t;
+
+// Parse a --pin spec ("compact", "scatter" or a CPU list) and build the CPU order, -1 if invalid
+int placement_parse(placement_t *placement, const char *spec);
+
+// CPU the TA with the given 0-based index should run on (-1 when not pinning)
+int placement_cpu_for_ta(const placement_t *placement, int ta_index);
+
+// Pin the calling process to one CPU, -1 on failure
+int placement_pin_self(int cpu);
+
+// Socket (physical package) of a CPU as reported by sysfs, -1 if unknown
+int placement_cpu_socket(int cpu);
+
+// Whether a NUMA node exists and is online (without NUMA support in sysfs, only node 0)
+int placement_node_online(int node);
+
+// Bind a memory range to a NUMA node (before it is first touched), -1 on failure
+int placement_bind_memory(void *addr, size_t length, int node);
+
+// NUMA node currently backing the page at addr, -1 if unknown
+int placement_memory_node(void *addr);
+
+const char *placement_mode_name(pin_mode_t mode);
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef TA_SHARED_H
+#define TA_SHARED_H
+
+#include <sys/types.h>
+
+#include "ta_lock.h"
+#include "ta_slab.h"
+
+// Layout of the Part B shared memory segment, shared with monitoring tools (ta_stat)
+
+#define MAX_EXAMS 100
+#define RUBRIC_SIZE 5
+#define MAX_LINE_LENGTH 100
+#define MAX_TAS 512
+#define MAX_FILENAME_LENGTH 64
+#define EXAM_QUEUE_SIZE 4   // Loaded exams waiting for markers in pipeline mode
+#define MAX_TEAMS 128
+#define TEAM_QUEUE_SIZE 4   // Exams a team holds at once (also its dispatch batch size)
+#define MAX_MARK 10         // Questions are marked out of this
+#define RUBRIC_HISTORY 32   // Rubric versions kept for exams still being marked
+#define MAX_PATH_LENGTH 256 // Daemon mode: batch directory (also a sharded run's course directories)
+#define MAX_SHARDS 16       // Courses in one sharded run, each in its own segment
+
+// Identifies a Part B segment (bump the low digits whenever the layout changes)
+#define SHARED_MAGIC 0x54414d16
+
+// Semaphore indices
+#define SEM_RUBRIC    0  // Controls rubric modification
+#define SEM_QUESTIONS 1  // Controls question marking
+#define SEM_SHARED    2 // Controls general shared data access
+#define SEM_SLOTS_FREE 3 // Pipeline: free exam queue slots (counting)
+#define SEM_WORK      4  // Pipeline: unclaimed questions in the queue (counting)
+#define SEM_BATCH     5  // Daemon: one token per TA for every batch started (counting)
+#define NUM_SEMAPHORES 6
+
+// How the shared-state lock (SEM_SHARED) is implemented
+#define LOCK_SYSV   0   // semop on SEM_SHARED (no ordering guarantee between waiters)
+#define LOCK_TICKET 1   // FIFO ticket lock in the segment (see ta_lock.h)
+
+// What a TA is currently doing (published for monitors, never read by other TAs)
+typedef enum {
+    TA_STARTING = 0,
+    TA_IDLE,              // Between steps of the main loop
+    TA_LOADING_EXAM,      // Transitioning to the next exam
+    TA_CHECKING_RUBRIC,   // Inside check_rubric
+    TA_MARKING,           // Marking a question
+    TA_EXITED
+} ta_state_t;
+
+// Role of a TA process (pipeline mode specializes them)
+typedef enum {
+    ROLE_ALL = 0,      // Classic TA: loads exams, checks the rubric and marks
+    ROLE_LOADER,       // Loads exams into the queue
+    ROLE_REVIEWER,     // Checks the rubric continuously
+    ROLE_MARKER        // Marks questions from the queue
+} ta_role_t;
+
+// Question states in a pipeline exam slot
+#define QUESTION_FREE    0
+#define QUESTION_CLAIMED 1
+#define QUESTION_DONE    2
+
+// One loaded exam: header plus where each answer section lives in its file
+typedef struct {
+    int exam_index;                     // Position in the exam sequence (0-based)
+    int student_id;
+    char header[MAX_LINE_LENGTH];       // Header line of the exam
+    char file[MAX_FILENAME_LENGTH];     // File the exam was loaded from
+    long answer_offset[RUBRIC_SIZE];    // Byte offset of each answer section in the file (-1 if absent)
+    long answer_length[RUBRIC_SIZE];    // Byte length of each answer section
+    int rubric_version;                 // Rubric version the exam is marked against (-1 if not pinned)
+} exam_info_t;
+
+// Pipeline exam queue entry
+typedef struct {
+    exam_info_t exam;
+    int question_state[RUBRIC_SIZE];    // QUESTION_FREE / CLAIMED / DONE
+    int claim_owner[RUBRIC_SIZE];       // TA id that claimed each question
+    long long claim_ms[RUBRIC_SIZE];    // When it was claimed (monotonic ms)
+    int speculator[RUBRIC_SIZE];        // TA id re-marking a straggler (0 if none)
+    int questions_done;
+} exam_slot_t;
+
+// Per-exam scheduling and progress record (indexed by exam file number - 1)
+typedef struct {
+    int priority;               // From the manifest: higher is marked first (0 = normal)
+    long long deadline_ms;      // From the manifest: due time after the run starts (0 = none)
+    int questions_done;         // Finished questions, updated atomically (no lock)
+    long long loaded_ms;        // Run-relative time the exam was loaded (-1 = not yet)
+    long long first_claim_ms;   // Run-relative time a TA first claimed one of its questions (-1 = not yet)
+    long long completed_ms;     // Run-relative time the last question finished (-1 = not yet)
+    int rubric_version;         // Rubric version pinned when the exam was first loaded (-1 = none)
+    int mark[RUBRIC_SIZE];      // Mark given for each question (-1 = not yet)
+    int mark_rubric_version[RUBRIC_SIZE];   // Rubric version each mark was given under
+    int mark_count[RUBRIC_SIZE];            // Marks recorded per question (atomic; should end at 1)
+    slab_offset_t result[RUBRIC_SIZE];      // mark_result_t in the segment's arena (SLAB_NULL = none)
+    int terminator;             // The 9999 exam: scheduled last and never marked
+} exam_record_t;
+
+// Result of marking one question, allocated from the segment's arena (its size depends
+// on the feedback text)
+typedef struct {
+    int ta_id;
+    int mark;
+    int rubric_version;
+    int words;                  // Words in the answer
+    char feedback[];            // NUL-terminated
+} mark_result_t;
+
+// One published rubric version; immutable until reclaimed
+typedef struct {
+    int version;                // -1: free slot
+    char lines[RUBRIC_SIZE][MAX_LINE_LENGTH];
+} rubric_snapshot_t;
+
+// Running statistics of the marks given for one question (Welford's online algorithm)
+typedef struct {
+    long long count;
+    double mean;
+    double m2;                      // Sum of squared deviations from the mean
+    int histogram[MAX_MARK + 1];    // Questions that got each mark
+} grade_stats_t;
+
+// Per-TA status slot, written only by its own TA so no lock is needed
+// (the one exception is retire_requested, which only the supervisor sets)
+typedef struct {
+    pid_t pid;
+    int role;               // ta_role_t
+    int state;              // ta_state_t
+    int waiting_sem;        // Semaphore index the TA is blocked on (-1 if none)
+    int question;           // Question being marked (0-based, -1 if none)
+    int student_id;         // Student whose exam the TA is working on
+    int questions_marked;   // Total questions this TA has marked
+    int cpu;                // CPU the TA last ran on (-1 before it starts)
+    int migrations;         // Times the TA was seen on a different CPU
+    long long state_since_ms;   // When the current state was entered
+    long long busy_ms;          // Time spent loading, checking the rubric or marking
+    long long idle_ms;          // Time spent idle or waiting for work
+    int retire_requested;       // Set by the autoscaling supervisor to shrink the pool
+    int marking_ewma_ms;        // Recent time per question (EWMA, 0 until the first one)
+    int tail_deferrals;         // Consecutive times this TA left tail questions to faster TAs
+    int lock_acquisitions;      // Times this TA took the shared-state lock
+    long long lock_wait_us;     // Total time spent waiting for it
+    long long lock_max_wait_us; // Longest single wait for it
+    // Recovery: what the parent must hand back if this TA dies
+    int claim_exam;             // Exam of the question being marked / exam being loaded (-1 if none)
+    int claim_question;         // Question being marked (-1 for a whole exam a loader took)
+    int holds_slot;             // Loader took a SEM_SLOTS_FREE token it has not used yet
+    int has_ticket;             // lock_ticket is queued for or holding the ticket lock
+    unsigned int lock_ticket;
+    int team;                   // Team mode: index into teams[]
+    int team_lock_acquisitions; // Times this TA took its team's lock
+    int has_team_ticket;        // Like has_ticket / lock_ticket, for the team lock
+    unsigned int team_ticket;
+    unsigned int grades_seq;    // Odd while grades[] is being updated (readers retry)
+    grade_stats_t grades[RUBRIC_SIZE];  // This TA's share of the per-question statistics
+    int rubric_pin;             // Rubric version this TA is pinning or reading (-1 if none)
+    int in_batch;               // Daemon: took a batch token and has not finished the batch yet
+    int in_shard;               // Sharded run: counted in this course's shard_tas
+    int shard;                  // Sharded run, first course's slot only: course the TA works on
+    slab_cache_t slab_cache;    // Free result records held back from the arena (see ta_slab.h)
+} ta_status_t;
+
+// Team mode: a group of TAs with its own lock and exam queue, refilled in batches from the
+// global dispatcher, so the global lock is taken once per batch instead of once per question
+typedef struct {
+    ticket_lock_t lock;                         // Protects everything below
+    exam_slot_t queue[TEAM_QUEUE_SIZE];         // Ring indexed by the counters below
+    int queue_head;                             // Exams ever queued to this team
+    int queue_tail;                             // Exams fully marked and retired
+    int refiller;                               // TA id fetching the next batch (0 if none)
+    int batch_count;                            // Exams the refiller took but has not queued yet
+    int batch_exams[TEAM_QUEUE_SIZE];
+    int drained;                                // Dispatcher empty and queue drained: team is done
+} team_t;
+
+// Shared memory structure
+typedef struct {
+    unsigned int magic;                         // SHARED_MAGIC once initialized
+    char rubric[RUBRIC_SIZE][MAX_LINE_LENGTH];  // Shared rubric data
+    exam_info_t current_exam;                   // Current exam (header and answer section index)
+    int questions_marked[RUBRIC_SIZE];          // Marking status (0 for non marked and available / 1 for marked and should not be )
+    int exams_finished;                          // Termination flag that all exams have been completed
+    int shutdown_requested;                     // Drain: finish the question in hand, take no new work
+    long long shutdown_ms;                      // Run-relative time the shutdown was requested
+    int current_exam_index;                     // Current exam position in the schedule
+    int schedule[MAX_EXAMS];                    // Exam indices in priority/deadline order (fixed at startup)
+    exam_record_t exam_records[MAX_EXAMS];      // Priority, deadline and completion of every exam
+    exam_info_t exam_catalog[MAX_EXAMS];        // --ingest: every exam loaded at startup (by exam index)
+    int catalog_ready[MAX_EXAMS];               // --ingest: exam_catalog entry is valid
+    int total_exams;                            // Total exams (20)
+    int rubric_version;                         // Bumped on every rubric correction
+    char rubric_on_disk[RUBRIC_SIZE][MAX_LINE_LENGTH];  // Rubric as last written to / read from the file
+    int rubric_reloads;                         // Outside edits of the rubric file published to the TAs
+    int rubric_reload_conflicts;                // Lines a TA had corrected that an outside edit overrode
+    int rubric_current;                         // Newest published rubric version (what new exams pin)
+    rubric_snapshot_t rubric_history[RUBRIC_HISTORY];   // Published versions still referenced
+    int rubric_published;                       // Versions published / reclaimed so far
+    int rubric_reclaimed;
+    int rubric_max_live;                        // Most versions held at once
+    int rubric_older_marks;                     // Marks given under an older version than the newest (atomic)
+    int num_tas;                                // Number of TA slots in use
+    int active_tas;                             // TAs currently running (changes under autoscaling)
+    long long start_time_ms;                    // CLOCK_MONOTONIC time the run started
+    int pipeline_mode;                          // TAs have dedicated roles (see ta_role_t)
+    exam_slot_t exam_queue[EXAM_QUEUE_SIZE];    // Pipeline: loaded exams, ring indexed by the counters below
+    int queue_head;                             // Pipeline: exams ever queued
+    int queue_tail;                             // Pipeline: exams fully marked and retired
+    int loading_done;                           // Pipeline: no more exams will be queued
+    int active_loaders;                         // Pipeline: loaders still running
+    int num_markers;                            // Pipeline: marker processes
+    int speed_aware;                            // Steer the last questions of an exam to faster TAs
+    int speculate;                              // Pipeline: idle fast TAs re-mark stragglers
+    int tail_deferrals;                         // Times a slow TA left a tail question (atomic)
+    int speculative_started;                    // Speculative re-marks started / won / wasted (atomic)
+    int speculative_won;
+    int speculative_wasted;
+    int num_orphaned;                           // Work of dead TAs waiting to be redone
+    int orphaned_exam[MAX_TAS];                 //   exam index
+    int orphaned_question[MAX_TAS];             //   question (-1: the whole exam needs loading)
+    int num_teams;                              // Team mode (0 = off)
+    int team_size;
+    int dispatch_done;                          // Team mode: the global dispatcher has no exams left
+    int teams_drained;                          // Team mode: teams that have finished
+    team_t teams[MAX_TEAMS];
+    int lock_mode;                              // LOCK_SYSV or LOCK_TICKET
+    ticket_lock_t shared_lock;                  // The shared-state lock in LOCK_TICKET mode
+    int daemon_mode;                            // TAs wait for the next batch instead of exiting
+    int batch_id;                               // Daemon: batches started so far
+    int batch_busy_tas;                         // Daemon: batch tokens not yet finished (atomic)
+    char batch_dir[MAX_PATH_LENGTH];            // Daemon: absolute directory of the current batch
+    int num_shards;                             // Sharded run: courses, one segment each (0 = not sharded)
+    int shard_index;                            // Sharded run: this segment's course (0-based)
+    int shard_tas;                              // Sharded run: TAs working on this course now (atomic)
+    int shard_arrivals;                         // Sharded run: times a TA moved here from another course (atomic)
+    char shard_dir[MAX_PATH_LENGTH];            // Sharded run: absolute directory of this course
+    ta_status_t tas[MAX_TAS];                   // One status slot per TA (TA n uses tas[n - 1])
+    slab_arena_t arena;                         // Variable-size records (mark results), by offset
+} shared_data_t;
+
+#endif
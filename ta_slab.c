@@ -0,0 +1,343 @@
+#include <string.h>
+
+#include "ta_slab.h"
+
+// Offset of the object that links a free object to the next one (first word of the object)
+static slab_offset_t *next_free(slab_arena_t *arena, slab_offset_t offset) {
+    return (slab_offset_t *)(arena->heap + offset);
+}
+
+static int class_size(int size_class) {
+    return SLAB_MIN_OBJECT << size_class;
+}
+
+// Smallest class that fits size (size <= SLAB_MAX_OBJECT)
+static int class_for(size_t size) {
+    int size_class = 0;
+    while ((size_t)class_size(size_class) < size) {
+        size_class++;
+    }
+    return size_class;
+}
+
+static int slabs_used(const slab_arena_t *arena) {
+    int used = 0;
+    for (int i = 0; i < SLAB_COUNT; i++) {
+        used += arena->slabs[i].size_class != SLAB_FREE;
+    }
+    return used;
+}
+
+// The arena lock, with the ticket published in the TA's cache before it blocks so the
+// parent can give it up if the TA dies (the parent itself passes NULL)
+static void arena_lock(slab_arena_t *arena, slab_cache_t *cache) {
+    unsigned int ticket = cache != NULL
+        ? ticket_lock_take(&arena->lock, cache->owner, &cache->ticket, &cache->has_ticket)
+        : ticket_lock_take(&arena->lock, TICKET_ANONYMOUS, NULL, NULL);
+    if (cache != NULL) {
+        cache->lock_acquisitions++;
+    }
+    ticket_lock_wait(&arena->lock, ticket);
+    if (cache == NULL) {
+        arena->lock_acquisitions++;
+    }
+}
+
+static void arena_unlock(slab_arena_t *arena, slab_cache_t *cache) {
+    ticket_lock_release(&arena->lock);
+    if (cache != NULL) {
+        cache->has_ticket = 0;  // A stale ticket is harmless: it has already been served
+    }
+}
+
+void slab_init(slab_arena_t *arena) {
+    ticket_lock_init(&arena->lock);
+    for (int i = 0; i < SLAB_COUNT; i++) {
+        arena->slabs[i] = (slab_header_t){SLAB_FREE, 0, 0, SLAB_NULL, -1};
+    }
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        arena->partial[c] = -1;
+    }
+}
+
+// Caller holds the lock. First run of count free slabs (lowest address first, which keeps
+// the heap compact), -1 if there is none.
+static int find_free_run(const slab_arena_t *arena, int count) {
+    int run = 0;
+    for (int i = 0; i < SLAB_COUNT; i++) {
+        run = arena->slabs[i].size_class == SLAB_FREE ? run + 1 : 0;
+        if (run == count) {
+            return i - count + 1;
+        }
+    }
+    return -1;
+}
+
+static void note_slabs_used(slab_arena_t *arena) {
+    int used = slabs_used(arena);
+    if (used > arena->peak_slabs) {
+        arena->peak_slabs = used;
+    }
+}
+
+// Caller holds the lock. Hand a free slab to a class, threading its objects into a free list.
+static int format_slab(slab_arena_t *arena, int size_class) {
+    int index = find_free_run(arena, 1);
+    if (index < 0) {
+        return -1;
+    }
+    int size = class_size(size_class);
+    slab_offset_t base = (slab_offset_t)index * SLAB_SIZE;
+    for (int object = 0; object < SLAB_SIZE / size; object++) {
+        slab_offset_t offset = base + (slab_offset_t)(object * size);
+        *next_free(arena, offset) = object + 1 < SLAB_SIZE / size ? offset + size : SLAB_NULL;
+    }
+    arena->slabs[index] = (slab_header_t){size_class, 1, 0, base, arena->partial[size_class]};
+    arena->partial[size_class] = index;
+    note_slabs_used(arena);
+    return index;
+}
+
+// Caller holds the lock. One object of a class, SLAB_NULL if the heap is full.
+static slab_offset_t take_object(slab_arena_t *arena, int size_class) {
+    int index = arena->partial[size_class];
+    if (index < 0 && (index = format_slab(arena, size_class)) < 0) {
+        return SLAB_NULL;
+    }
+    slab_header_t *slab = &arena->slabs[index];
+    slab_offset_t offset = slab->free_list;
+    slab->free_list = *next_free(arena, offset);
+    slab->in_use++;
+    if (slab->free_list == SLAB_NULL) {
+        arena->partial[size_class] = slab->next_partial;  // Full: no longer a candidate
+        slab->next_partial = -1;
+    }
+    return offset;
+}
+
+static void unlink_partial(slab_arena_t *arena, int size_class, int index) {
+    int *link = &arena->partial[size_class];
+    while (*link >= 0 && *link != index) {
+        link = &arena->slabs[*link].next_partial;
+    }
+    if (*link == index) {
+        *link = arena->slabs[index].next_partial;
+    }
+}
+
+// Caller holds the lock. Return an object to its slab; an empty slab goes back to the heap.
+static void put_object(slab_arena_t *arena, slab_offset_t offset) {
+    int index = (int)(offset / SLAB_SIZE);
+    slab_header_t *slab = &arena->slabs[index];
+    int was_full = slab->free_list == SLAB_NULL;
+    *next_free(arena, offset) = slab->free_list;
+    slab->free_list = offset;
+    slab->in_use--;
+    if (was_full) {
+        slab->next_partial = arena->partial[slab->size_class];
+        arena->partial[slab->size_class] = index;
+    }
+    if (slab->in_use == 0) {
+        unlink_partial(arena, slab->size_class, index);
+        *slab = (slab_header_t){SLAB_FREE, 0, 0, SLAB_NULL, -1};
+    }
+}
+
+// Caller holds the lock. A run of whole slabs for a request larger than any class.
+static slab_offset_t take_large(slab_arena_t *arena, size_t size) {
+    int count = (int)((size + SLAB_SIZE - 1) / SLAB_SIZE);
+    int first = count <= SLAB_COUNT ? find_free_run(arena, count) : -1;
+    if (first < 0) {
+        return SLAB_NULL;
+    }
+    arena->slabs[first] = (slab_header_t){SLAB_LARGE, count, 1, SLAB_NULL, -1};
+    for (int i = first + 1; i < first + count; i++) {
+        arena->slabs[i] = (slab_header_t){SLAB_LARGE_TAIL, 0, 0, SLAB_NULL, -1};
+    }
+    note_slabs_used(arena);
+    return (slab_offset_t)first * SLAB_SIZE;
+}
+
+static void put_large(slab_arena_t *arena, int first) {
+    int count = arena->slabs[first].run;
+    for (int i = first; i < first + count; i++) {
+        arena->slabs[i] = (slab_header_t){SLAB_FREE, 0, 0, SLAB_NULL, -1};
+    }
+}
+
+slab_offset_t slab_alloc(slab_arena_t *arena, slab_cache_t *cache, size_t size) {
+    size_t rounded;
+    slab_offset_t offset;
+    if (size > SLAB_MAX_OBJECT) {
+        rounded = (size + SLAB_SIZE - 1) / SLAB_SIZE * SLAB_SIZE;
+        arena_lock(arena, cache);
+        offset = take_large(arena, size);
+        arena->failures += offset == SLAB_NULL;
+        arena_unlock(arena, cache);
+    } else {
+        int size_class = class_for(size);
+        rounded = class_size(size_class);
+        if (cache == NULL) {
+            arena_lock(arena, NULL);
+            offset = take_object(arena, size_class);
+            arena->failures += offset == SLAB_NULL;
+            arena_unlock(arena, NULL);
+        } else {
+            if (cache->count[size_class] > 0) {
+                cache->cache_hits++;
+            } else {
+                // Refill a batch at once so the next few allocations skip the lock.
+                // Each object is counted only once it is in the cache: a TA that dies
+                // here leaks at most one object, it never hands one out twice.
+                arena_lock(arena, cache);
+                for (int i = 0; i < SLAB_CACHE_BATCH; i++) {
+                    slab_offset_t refill = take_object(arena, size_class);
+                    if (refill == SLAB_NULL) {
+                        arena->failures += i == 0;
+                        break;
+                    }
+                    cache->objects[size_class][cache->count[size_class]] = refill;
+                    cache->count[size_class]++;
+                }
+                arena_unlock(arena, cache);
+            }
+            if (cache->count[size_class] == 0) {
+                return SLAB_NULL;
+            }
+            offset = cache->objects[size_class][--cache->count[size_class]];
+        }
+    }
+    if (offset == SLAB_NULL) {
+        return SLAB_NULL;
+    }
+
+    // Only the owner writes its cache's counters, and only the parent allocates without one
+    long long *allocs = cache != NULL ? &cache->allocs : &arena->allocs;
+    long long *requested = cache != NULL ? &cache->requested_bytes : &arena->requested_bytes;
+    long long *allocated = cache != NULL ? &cache->rounded_bytes : &arena->rounded_bytes;
+    (*allocs)++;
+    *requested += (long long)size;
+    *allocated += (long long)rounded;
+    return offset;
+}
+
+void slab_free(slab_arena_t *arena, slab_cache_t *cache, slab_offset_t offset) {
+    if (offset == SLAB_NULL || offset >= SLAB_ARENA_SIZE) {
+        return;
+    }
+    if (cache != NULL) {
+        cache->frees++;
+    } else {
+        arena->frees++;
+    }
+
+    // The slab header says what the object is; nothing else touches it while it is handed out
+    int index = (int)(offset / SLAB_SIZE);
+    int size_class = arena->slabs[index].size_class;
+    if (size_class == SLAB_LARGE || cache == NULL) {
+        arena_lock(arena, cache);
+        if (size_class == SLAB_LARGE) {
+            put_large(arena, index);
+        } else {
+            put_object(arena, offset);
+        }
+        arena_unlock(arena, cache);
+        return;
+    }
+
+    if (cache->count[size_class] == SLAB_CACHE_SIZE) {
+        // Full: hand a batch back (uncounted before it is returned, see slab_alloc)
+        arena_lock(arena, cache);
+        for (int i = 0; i < SLAB_CACHE_BATCH; i++) {
+            slab_offset_t flushed = cache->objects[size_class][cache->count[size_class] - 1];
+            cache->count[size_class]--;
+            put_object(arena, flushed);
+        }
+        arena_unlock(arena, cache);
+    }
+    cache->objects[size_class][cache->count[size_class]] = offset;
+    cache->count[size_class]++;
+}
+
+void *slab_ptr(slab_arena_t *arena, slab_offset_t offset) {
+    return offset == SLAB_NULL ? NULL : arena->heap + offset;
+}
+
+const void *slab_const_ptr(const slab_arena_t *arena, slab_offset_t offset) {
+    return offset == SLAB_NULL ? NULL : arena->heap + offset;
+}
+
+void slab_cache_drain(slab_arena_t *arena, slab_cache_t *cache) {
+    int cached = 0;
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        cached += cache->count[c];
+    }
+    if (cached == 0) {
+        return;
+    }
+    arena_lock(arena, cache);
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        while (cache->count[c] > 0) {
+            slab_offset_t offset = cache->objects[c][cache->count[c] - 1];
+            cache->count[c]--;
+            put_object(arena, offset);
+        }
+    }
+    arena_unlock(arena, cache);
+}
+
+void slab_collect(const slab_arena_t *arena, slab_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    int run = 0;
+    for (int i = 0; i < SLAB_COUNT; i++) {
+        const slab_header_t *slab = &arena->slabs[i];
+        if (slab->size_class == SLAB_FREE) {
+            report->slabs_free++;
+            if (++run > report->largest_free_run) {
+                report->largest_free_run = run;
+            }
+            continue;
+        }
+        run = 0;
+        report->slabs_used++;
+        if (slab->size_class == SLAB_LARGE) {
+            report->live_bytes += (long long)slab->run * SLAB_SIZE;
+        } else if (slab->size_class >= 0) {
+            int size = class_size(slab->size_class);
+            report->class_slabs[slab->size_class]++;
+            report->live_bytes += (long long)slab->in_use * size;
+            report->partial_free_bytes += (long long)(SLAB_SIZE / size - slab->in_use) * size;
+        }
+    }
+    report->peak_slabs = arena->peak_slabs;
+    report->allocs = arena->allocs;
+    report->frees = arena->frees;
+    report->lock_acquisitions = arena->lock_acquisitions;
+    report->failures = arena->failures;
+    report->requested_bytes = arena->requested_bytes;
+    report->rounded_bytes = arena->rounded_bytes;
+}
+
+void slab_collect_cache(const slab_cache_t *cache, slab_report_t *report) {
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        // Objects in a cache are out of their slab but not with a caller
+        long long bytes = (long long)cache->count[c] * class_size(c);
+        report->cached_bytes += bytes;
+        report->live_bytes -= bytes;
+    }
+    report->allocs += cache->allocs;
+    report->cache_allocs += cache->allocs;
+    report->frees += cache->frees;
+    report->cache_hits += cache->cache_hits;
+    report->lock_acquisitions += cache->lock_acquisitions;
+    report->requested_bytes += cache->requested_bytes;
+    report->rounded_bytes += cache->rounded_bytes;
+}
+
+double slab_internal_fragmentation(const slab_report_t *report) {
+    return report->rounded_bytes > 0 ? 1.0 - (double)report->requested_bytes / report->rounded_bytes : 0.0;
+}
+
+double slab_external_fragmentation(const slab_report_t *report) {
+    return report->slabs_free > 0 ? 1.0 - (double)report->largest_free_run / report->slabs_free : 0.0;
+}
@@ -0,0 +1,115 @@
+#ifndef TA_SLAB_H
+#define TA_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ta_lock.h"
+
+// Slab allocator for variable-size records inside a shared memory segment. The arena lives
+// in the segment itself and hands out offsets from its heap instead of pointers, so a record
+// stays valid whatever address a process (a TA, the parent, ta_stat) attached the segment at.
+//
+// Objects of up to SLAB_MAX_OBJECT bytes come from power-of-two size classes, each carved out
+// of whole slabs; larger requests take a run of contiguous slabs. The arena is protected by a
+// ticket lock, but each TA keeps a small cache of free objects per class in its own status
+// slot and only takes the lock to move SLAB_CACHE_BATCH objects at a time.
+
+#define SLAB_ARENA_SIZE  (2 * 1024 * 1024)  // Heap bytes in each segment
+#define SLAB_SIZE        (16 * 1024)        // Unit handed to a size class or a large request
+#define SLAB_COUNT       (SLAB_ARENA_SIZE / SLAB_SIZE)
+#define SLAB_CLASSES     8                  // 32, 64, ... 4096-byte objects
+#define SLAB_MIN_OBJECT  32
+#define SLAB_MAX_OBJECT  (SLAB_MIN_OBJECT << (SLAB_CLASSES - 1))
+#define SLAB_CACHE_SIZE  8                  // Free objects a TA keeps per class
+#define SLAB_CACHE_BATCH 4                  // Objects moved between a cache and the arena at once
+
+#define SLAB_NULL 0xffffffffu
+
+typedef uint32_t slab_offset_t;
+
+// One slab of the heap
+typedef struct {
+    int size_class;             // Class index, or SLAB_FREE / SLAB_LARGE / SLAB_LARGE_TAIL
+    int run;                    // SLAB_LARGE: slabs in the run
+    int in_use;                 // Objects out of the slab (with callers or in TA caches)
+    slab_offset_t free_list;    // First free object, linked through the objects themselves
+    int next_partial;           // Next slab of the class with free objects (-1: none)
+} slab_header_t;
+
+#define SLAB_FREE       -1
+#define SLAB_LARGE      -2
+#define SLAB_LARGE_TAIL -3
+
+// Per-TA cache, kept in the TA's status slot and written only by that TA (a replacement TA
+// inherits it if the TA dies). The counters are the TA's share of the statistics.
+typedef struct {
+    int count[SLAB_CLASSES];
+    slab_offset_t objects[SLAB_CLASSES][SLAB_CACHE_SIZE];
+    long long allocs;
+    long long frees;
+    long long cache_hits;           // Allocations served without the arena lock
+    long long lock_acquisitions;    // Refills, flushes and large requests
+    long long requested_bytes;      // Asked for, and handed out after rounding up
+    long long rounded_bytes;
+    int owner;                      // pid of the TA, its taker id for the arena lock
+    int has_ticket;                 // ticket is queued for or holding the arena lock
+    unsigned int ticket;
+} slab_cache_t;
+
+typedef struct {
+    ticket_lock_t lock;                 // Protects everything below except the heap objects
+    slab_header_t slabs[SLAB_COUNT];
+    int partial[SLAB_CLASSES];          // First slab of each class with free objects (-1: none)
+    long long lock_acquisitions;        // Totals of allocations without a TA cache (the parent)
+    long long allocs;
+    long long frees;
+    long long requested_bytes;
+    long long rounded_bytes;
+    long long failures;                 // Requests the heap could not satisfy
+    int peak_slabs;                     // Most slabs in use at once
+    unsigned char heap[SLAB_ARENA_SIZE] __attribute__((aligned(64)));
+} slab_arena_t;
+
+// Usage and fragmentation, from slab_collect plus slab_collect_cache for every TA
+typedef struct {
+    int slabs_used;
+    int slabs_free;
+    int peak_slabs;
+    int largest_free_run;           // Longest run of free slabs (biggest large request possible)
+    int class_slabs[SLAB_CLASSES];
+    long long live_bytes;           // Objects with callers (rounded sizes)
+    long long cached_bytes;         // Free objects parked in TA caches
+    long long partial_free_bytes;   // Free objects inside slabs that are partly in use
+    long long allocs, frees, cache_hits, lock_acquisitions, failures;
+    long long cache_allocs;         // Allocations through a TA cache (cache_hits are a share of these)
+    long long requested_bytes, rounded_bytes;
+} slab_report_t;
+
+// An empty arena (the segment is zero-filled, this sets up the free lists)
+void slab_init(slab_arena_t *arena);
+
+// Allocate size bytes, SLAB_NULL if the heap is exhausted. cache is the calling TA's
+// cache, or NULL to go to the arena directly (the parent).
+slab_offset_t slab_alloc(slab_arena_t *arena, slab_cache_t *cache, size_t size);
+
+// Free an object from slab_alloc (SLAB_NULL is ignored)
+void slab_free(slab_arena_t *arena, slab_cache_t *cache, slab_offset_t offset);
+
+// The object at an offset, valid in any process that has the segment attached
+void *slab_ptr(slab_arena_t *arena, slab_offset_t offset);
+const void *slab_const_ptr(const slab_arena_t *arena, slab_offset_t offset);
+
+// Return every object in a cache to the arena (a TA on its way out)
+void slab_cache_drain(slab_arena_t *arena, slab_cache_t *cache);
+
+// Statistics: the arena's own, then add each TA cache
+void slab_collect(const slab_arena_t *arena, slab_report_t *report);
+void slab_collect_cache(const slab_cache_t *cache, slab_report_t *report);
+
+// Unused share of the handed-out bytes (rounding up to a class), and share of the free
+// heap that cannot serve the largest possible large request (free slabs not in one run)
+double slab_internal_fragmentation(const slab_report_t *report);
+double slab_external_fragmentation(const slab_report_t *report);
+
+#endif
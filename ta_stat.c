@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "ta_ipc.h"
+#include "ta_shared.h"
+#include "ta_grades.h"
+
+// ta_stat: read-only, lock-free live view of a running ta_partB session.
+// It never touches the run's semaphores, so attaching cannot slow the TAs down;
+// the price is that each refresh is a slightly racy snapshot.
+
+static const char *state_names[] = {
+    "starting", "idle", "loading exam", "checking rubric", "marking", "exited"
+};
+
+static const char *sem_names[NUM_SEMAPHORES] = {
+    "SEM_RUBRIC", "SEM_QUESTIONS", "SEM_SHARED", "SEM_SLOTS_FREE", "SEM_WORK", "SEM_BATCH"
+};
+
+static const char *role_names[] = {
+    "all", "loader", "reviewer", "marker"
+};
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const char *state_name(int state) {
+    if (state < 0 || state > TA_EXITED) {
+        return "?";
+    }
+    return state_names[state];
+}
+
+// Draw one frame; exams/sec is measured between consecutive frames
+static void draw(const shared_data_t *shared_data, pid_t run_pid, int last_index,
+                 long long last_ms, int clear_screen) {
+    long long now = monotonic_ms();
+    int exam_index = shared_data->current_exam_index;
+    double elapsed = (now - shared_data->start_time_ms) / 1000.0;
+    double window = (now - last_ms) / 1000.0;
+    double rate = window > 0 ? (exam_index - last_index) / window : 0.0;
+    double average = elapsed > 0 ? exam_index / elapsed : 0.0;
+
+    int num_tas = shared_data->num_tas;
+    if (num_tas > MAX_TAS) {
+        num_tas = MAX_TAS;
+    }
+
+    int in_flight = 0;
+    for (int i = 0; i < num_tas; i++) {
+        if (shared_data->tas[i].state == TA_MARKING) {
+            in_flight++;
+        }
+    }
+
+    if (clear_screen) {
+        printf("\033[H\033[2J");
+    }
+    printf("ta_stat - run %d   elapsed %.1fs   %s\n", (int)run_pid, elapsed,
+           shared_data->exams_finished ? "FINISHED" : shared_data->shutdown_requested ? "DRAINING" : "running");
+    printf("Exam %d/%d   %.2f exams/s (avg %.2f)   questions in flight: %d   rubric v%d\n",
+           exam_index + 1, shared_data->total_exams, rate, average, in_flight, shared_data->rubric_version);
+    if (shared_data->num_shards > 0) {
+        printf("Course %d of %d: %s   %d TA(s) working on it   %d arrival(s) from other courses\n",
+               shared_data->shard_index + 1, shared_data->num_shards, shared_data->shard_dir,
+               shared_data->shard_tas, shared_data->shard_arrivals);
+    }
+    if (shared_data->daemon_mode) {
+        printf("Daemon: batch %d from %s (%s)\n", shared_data->batch_id, shared_data->batch_dir,
+               shared_data->batch_busy_tas > 0 ? "marking" : "idle");
+    }
+    if (!shared_data->pipeline_mode) {
+        printf("Current exam: %s (student %d)\n", shared_data->current_exam.file,
+               shared_data->current_exam.student_id);
+    } else {
+        printf("Pipeline: %d/%d exams queued, %d retired, %d loader(s) active\n",
+               shared_data->queue_head - shared_data->queue_tail, EXAM_QUEUE_SIZE,
+               shared_data->queue_tail, shared_data->active_loaders);
+    }
+    printf("\n");
+
+    printf("%-5s %-8s %-4s %-9s %-16s %-14s %-9s %-8s %s\n",
+           "TA", "PID", "CPU", "ROLE", "STATE", "WAITING ON", "QUESTION", "STUDENT", "MARKED");
+    for (int i = 0; i < num_tas; i++) {
+        const ta_status_t *ta = &shared_data->tas[i];
+        int waiting = ta->waiting_sem;
+        const char *waiting_on = (waiting >= 0 && waiting < NUM_SEMAPHORES) ? sem_names[waiting] : "-";
+
+        char question[16] = "-";
+        if (ta->state == TA_MARKING && ta->question >= 0) {
+            snprintf(question, sizeof(question), "Q%d", ta->question + 1);
+        }
+
+        const char *role = (ta->role >= ROLE_ALL && ta->role <= ROLE_MARKER) ? role_names[ta->role] : "?";
+        printf("%-5d %-8d %-4d %-9s %-16s %-14s %-9s %-8d %d\n", i + 1, (int)ta->pid, ta->cpu, role,
+               state_name(ta->state), waiting_on, question, ta->student_id, ta->questions_marked);
+    }
+
+    // Merged from the per-TA partials, so reading them never blocks a TA
+    grade_stats_t grades[RUBRIC_SIZE];
+    grades_collect(shared_data, grades);
+    printf("\nGrades (out of %d):", MAX_MARK);
+    for (int q = 0; q < RUBRIC_SIZE; q++) {
+        printf("  Q%d n=%lld mean %.1f sd %.1f", q + 1, grades[q].count, grades[q].mean,
+               grades_stddev(&grades[q]));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    pid_t run_pid = 0;
+    int once = 0;
+    int course = 1;     // --shard=N: course of a sharded run (1-based, as in ta_partB's output)
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--once") == 0) {
+            once = 1;
+        } else if (strncmp(argv[i], "--shard=", 8) == 0 && atoi(argv[i] + 8) > 0) {
+            course = atoi(argv[i] + 8);
+        } else if (atoi(argv[i]) > 0) {
+            run_pid = (pid_t)atoi(argv[i]);
+        } else {
+            printf("Usage: %s [run_pid] [--shard=N] [--once]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    ipc_run_t run;
+    if (ipc_lookup_shard(run_pid, course - 1, &run) == -1 || run.shmid == -1) {
+        printf("No running marking session found%s%s\n", run_pid ? " for that pid" : "",
+               course > 1 ? " with that course" : "");
+        exit(1);
+    }
+
+    // SHM_RDONLY: the monitor can never corrupt the session
+    const shared_data_t *shared_data = (const shared_data_t *)shmat(run.shmid, NULL, SHM_RDONLY);
+    if (shared_data == (void *)-1) {
+        perror("shmat failed");
+        exit(1);
+    }
+    if (shared_data->magic != SHARED_MAGIC) {
+        printf("Segment %d is not an initialized ta_partB session\n", run.shmid);
+        shmdt(shared_data);
+        exit(1);
+    }
+
+    int last_index = shared_data->current_exam_index;
+    long long last_ms = monotonic_ms();
+    while (1) {
+        if (!once) {
+            sleep(1);
+        }
+        draw(shared_data, run.owner_pid, last_index, last_ms, !once);
+        last_index = shared_data->current_exam_index;
+        last_ms = monotonic_ms();
+
+        // Stop once the session is done or its parent has gone away
+        if (once || (shared_data->exams_finished && !shared_data->daemon_mode) || shared_data->active_tas == 0 ||
+            (kill(run.owner_pid, 0) == -1 && errno == ESRCH)) {
+            break;
+        }
+    }
+
+    shmdt(shared_data);
+    return 0;
+}